@@ -3,8 +3,11 @@
 
 struct ObjectData
 {
-	mat4 model;
-	mat4 normalMatrix;
+	mat4  model;
+	mat4  normalMatrix;
+	vec4  aabbMin;
+	vec4  aabbMax;
+	uvec4 draw;
 };
 
 layout(binding = 0) uniform UniformBufferObject
@@ -19,6 +22,11 @@ layout(std140, binding = 1) readonly buffer ObjectBuffer
 	ObjectData objects[];
 } objectBuffer;
 
+layout(std430, binding = 4) readonly buffer InstanceBuffer
+{
+	uint objects[];
+} instanceBuffer;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec3 inNormal;
@@ -31,8 +39,11 @@ layout(location = 3) out vec2 fragTexCoord;
 
 void main()
 {
-	const mat4 model        = objectBuffer.objects[gl_BaseInstance].model;
-	const mat4 normalMatrix = objectBuffer.objects[gl_BaseInstance].normalMatrix;
+	// gl_InstanceIndex already includes firstInstance.
+	const uint object = instanceBuffer.objects[gl_InstanceIndex];
+
+	const mat4 model        = objectBuffer.objects[object].model;
+	const mat4 normalMatrix = objectBuffer.objects[object].normalMatrix;
 
 	const vec4 worldPos = model * vec4(inPosition, 1.0);
 	gl_Position         = ubo.projView * worldPos;
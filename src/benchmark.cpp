@@ -0,0 +1,102 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <numeric>
+
+#include "benchmark.hpp"
+#include "options.hpp"
+
+Benchmark::Benchmark(const Options& options):
+	options(options)
+{
+	samples.reserve(options.frames);
+}
+
+void Benchmark::record(uint32_t frame, const FrameTimes& times)
+{
+	if(frame >= options.warmup)
+		samples.push_back(times);
+}
+
+void Benchmark::reportTask(std::ostream& os, std::string_view name, FrameTimes::duration FrameTimes::* task) const
+{
+	std::vector<double> values;
+	values.reserve(samples.size());
+
+	for(const auto& sample: samples)
+		values.push_back((sample.*task).count());
+
+	std::sort(values.begin(), values.end());
+
+	// Nearest rank
+	auto percentile = [&values](double p) -> double
+	{
+		if(values.empty())
+			return 0;
+
+		size_t rank = std::ceil(p/100 * values.size());
+
+		return values[std::max<size_t>(rank, 1) - 1];
+	};
+
+	double mean = values.empty() ? 0 : std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+
+	os
+		<< "\t\t\"" << name << "\": {"
+		<< "\"mean\": " << mean << ", "
+		<< "\"p50\": "  << percentile(50) << ", "
+		<< "\"p90\": "  << percentile(90) << ", "
+		<< "\"p99\": "  << percentile(99) << ", "
+		<< "\"max\": "  << percentile(100) << "}"
+	;
+}
+
+void Benchmark::report(std::ostream& os) const
+{
+	FrameTimes::duration total(0);
+
+	for(const auto& sample: samples)
+		total += sample.frame;
+
+	double fps = total.count() > 0 ? samples.size() / std::chrono::duration<double>(total).count() : 0;
+
+	os
+		<< std::boolalpha
+		<< "{\n"
+		<< "\t\"scene\": "        << std::quoted(options.scene.string()) << ",\n"
+		<< "\t\"headless\": "     << options.headless << ",\n"
+		<< "\t\"warmupFrames\": " << options.warmup << ",\n"
+		<< "\t\"frames\": "       << samples.size() << ",\n"
+		<< "\t\"delta\": "        << options.delta << ",\n"
+		<< "\t\"fps\": "          << fps << ",\n"
+		<< "\t\"unit\": \"ms\",\n"
+		<< "\t\"tasks\": {\n"
+	;
+
+	reportTask(os, "frame",    &FrameTimes::frame);    os << ",\n";
+	reportTask(os, "game",     &FrameTimes::game);     os << ",\n";
+	reportTask(os, "physics",  &FrameTimes::physics);  os << ",\n";
+	reportTask(os, "snapshot", &FrameTimes::snapshot); os << ",\n";
+	reportTask(os, "renderer", &FrameTimes::renderer); os << "\n";
+
+	os
+		<< "\t}\n"
+		<< "}\n"
+	;
+}
@@ -0,0 +1,65 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+struct Options;
+
+struct FrameTimes
+{
+	using duration = std::chrono::duration<double, std::milli>;
+
+	duration frame;
+	duration game;
+	duration physics;
+	duration snapshot;
+	duration renderer;
+};
+
+/// Stores the time spent in f.
+template<typename F>
+void measure(FrameTimes::duration& time, F&& f)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	f();
+
+	time = std::chrono::steady_clock::now() - start;
+}
+
+class Benchmark
+{
+private:
+	const Options&          options;
+	std::vector<FrameTimes> samples;
+
+	void reportTask(std::ostream& os, std::string_view name, FrameTimes::duration FrameTimes::* task) const;
+
+public:
+	Benchmark(const Options& options);
+
+	/// Warm-up frames are not recorded.
+	void record(uint32_t frame, const FrameTimes& times);
+
+	/// Writes the percentiles of every task as JSON.
+	void report(std::ostream& os) const;
+};
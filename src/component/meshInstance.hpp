@@ -26,6 +26,9 @@ struct alignas(64) MeshInstance
 	// Contains the indices of the meshes.
 	boost::container::small_vector<uint32_t, 8> meshes;
 
+	// Render list slots, one for each mesh.
+	boost::container::small_vector<uint32_t, 8> slots;
+
 	// TODO: Use entt::resource
 };
 
@@ -32,6 +32,9 @@ struct Transform
 		entt::entity parent;
 	};
 
+	/// Tag for transforms that changed since the last world transform update.
+	struct Dirty {};
+
 	glm::mat4 matrix;
 };
 
@@ -21,3 +21,6 @@
 extern const std::filesystem::path dataDir;
 extern const std::filesystem::path shadersDir;
 extern const std::filesystem::path texturesDir;
+
+/// $XDG_CACHE_HOME/vulkan-hello
+extern const std::filesystem::path cacheDir;
@@ -15,16 +15,20 @@
 // along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <chrono>
+#include <fstream>
+#include <iostream>
 
 #include <taskflow/taskflow.hpp>
 
+#include "benchmark.hpp"
 #include "engine.hpp"
 #include "input.hpp"
 #include "system/game.hpp"
 #include "system/physics.hpp"
 
-Engine::Engine(const std::filesystem::path& mainScene):
-	mainScene(mainScene),
+Engine::Engine(const Options& options):
+	options(options),
+	mainScene(options.scene),
 	window(*this)
 {
 	emplace_injectable<Input>(*this);
@@ -41,11 +45,14 @@ int Engine::run()
 	auto currentTime = high_resolution_clock::now();
 	auto lastTime = currentTime;
 
-	float delta      = 1.f/60;
+	float delta      = options.benchmark ? options.delta : 1.f/60;
 
 	tf::Executor executor;
 	tf::Taskflow gameloop_taskflow;
 
+	Benchmark  benchmark(options);
+	FrameTimes times;
+
 	auto& game     = emplace_injectable<Game>(*this);
 	auto& physics  = emplace_injectable<Physics>(*this);
 	auto& renderer = emplace_injectable<Renderer>(*this);
@@ -54,9 +61,22 @@ int Engine::run()
 	tf::Task start = gameloop_taskflow.placeholder();
 
 	// TODO: Pass subflow in a better way
-	tf::Task game_task     = gameloop_taskflow.emplace([&](){game.update(delta, nullptr);});
-	tf::Task physics_task  = gameloop_taskflow.emplace([&](tf::Subflow& sbf){physics.update(delta, &sbf);});
-	tf::Task renderer_task = gameloop_taskflow.emplace([&](){renderer.update(delta, nullptr);});
+	tf::Task game_task = gameloop_taskflow.emplace([&](){
+		measure(times.game, [&](){game.update(delta, nullptr);});
+	});
+
+	tf::Task physics_task = gameloop_taskflow.emplace([&](tf::Subflow& sbf){
+		// Joined here so the subflow is part of the measurement.
+		measure(times.physics, [&](){physics.update(delta, &sbf); sbf.join();});
+	});
+
+	tf::Task snapshot_task = gameloop_taskflow.emplace([&](){
+		measure(times.snapshot, [&](){updateRenderSnapshot();});
+	});
+
+	tf::Task renderer_task = gameloop_taskflow.emplace([&](tf::Subflow& sbf){
+		measure(times.renderer, [&](){renderer.update(delta, &sbf); sbf.join();});
+	});
 
 	tf::Task end = gameloop_taskflow.placeholder();
 
@@ -66,19 +86,23 @@ int Engine::run()
 
 	game_task.name("Game");
 	physics_task.name("Physics");
+	snapshot_task.name("Snapshot");
 	renderer_task.name("Renderer");
 
 	end.name("End");
 
 	// Dependencies
+	// The simulation of frame N+1 runs while the renderer draws the
+	// snapshot of frame N, they never touch the same data.
 	start.precede(end);
 
 	start.precede(game_task);
-	start.precede(physics_task);
 	start.precede(renderer_task);
 
-	game_task.precede(end);
-	physics_task.precede(end);
+	game_task.precede(physics_task);
+	physics_task.precede(snapshot_task);
+
+	snapshot_task.precede(end);
 	renderer_task.precede(end);
 
 	//gameloop_taskflow.dump(std::cout);
@@ -89,15 +113,50 @@ int Engine::run()
 	physics.init();
 	renderer.init();
 
-	while(!glfwWindowShouldClose(getWindow()))
+	// The first frame draws the loaded scene.
+	updateRenderSnapshot();
+	swapRenderSnapshots();
+
+	for(uint32_t frame = 0; !shouldClose(frame); frame++)
 	{
 		lastTime = currentTime;
 
-		glfwPollEvents();
-		executor.run(gameloop_taskflow).wait();
+		measure(times.frame, [&](){
+			if(!options.headless)
+				glfwPollEvents();
+			executor.run(gameloop_taskflow).wait();
+		});
+
+		swapRenderSnapshots();
+
+		if(options.benchmark)
+			benchmark.record(frame, times);
 
 		currentTime = high_resolution_clock::now();
-		delta       = duration<float, seconds::period>(currentTime - lastTime).count();
+
+		// A fixed delta keeps benchmark runs deterministic.
+		if(!options.benchmark)
+			delta = duration<float, seconds::period>(currentTime - lastTime).count();
+	}
+
+	if(options.benchmark)
+	{
+		if(options.output.empty())
+		{
+			benchmark.report(std::cout);
+		}
+		else
+		{
+			std::ofstream file(options.output);
+
+			if(!file)
+			{
+				std::cerr << "Couldn't open " << options.output << '\n';
+				return EXIT_FAILURE;
+			}
+
+			benchmark.report(file);
+		}
 	}
 
 	return EXIT_SUCCESS;
@@ -113,16 +172,55 @@ GLFWwindow* Engine::getWindow()
 	return window.getWindow();
 }
 
+glm::ivec2 Engine::getWindowSize() const
+{
+	return window.getSize();
+}
+
 Settings& Engine::getSettings()
 {
 	return settings;
 }
 
+const Options& Engine::getOptions() const
+{
+	return options;
+}
+
+bool Engine::shouldClose(uint32_t frame)
+{
+	uint32_t lastFrame = options.frames;
+
+	if(options.benchmark)
+		lastFrame += options.warmup;
+
+	if(options.frames != 0 && frame >= lastFrame)
+		return true;
+
+	return !options.headless && glfwWindowShouldClose(getWindow());
+}
+
 void Engine::setRenderer(Renderer* renderer)
 {
 	activeRenderer = renderer;
 }
 
+const RenderSnapshot& Engine::getRenderSnapshot() const
+{
+	return renderSnapshots[1 - writeSnapshot];
+}
+
+void Engine::updateRenderSnapshot()
+{
+	mainScene.updateWorldTransforms();
+	mainScene.renderList.sync(renderSnapshots[writeSnapshot], renderSnapshots[1 - writeSnapshot]);
+}
+
+void Engine::swapRenderSnapshots()
+{
+	writeSnapshot = 1 - writeSnapshot;
+}
+
 void Engine::framebufferResizeCallback(GLFWwindow* window, int width, int height)
 {
 	auto engine = reinterpret_cast<Engine*>(glfwGetWindowUserPointer(window));
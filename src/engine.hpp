@@ -16,10 +16,12 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <filesystem>
 
 #include "injector.hpp"
+#include "options.hpp"
 #include "scene.hpp"
 #include "settings.hpp"
 #include "vulkan/renderer.hpp"
@@ -30,16 +32,21 @@ class Input;
 class Engine: public Injector
 {
 public:
-	Engine(const std::filesystem::path& mainScene);
+	Engine(const Options& options);
 	~Engine();
 
 	/// Starts the engine and returns an exit code.
 	int run();
 
-	Scene&      getActiveScene();
-	GLFWwindow* getWindow();
-	Settings&   getSettings();
-	void        setRenderer(Renderer* renderer);
+	Scene&         getActiveScene();
+	GLFWwindow*    getWindow();
+	glm::ivec2     getWindowSize() const;
+	Settings&      getSettings();
+	const Options& getOptions() const;
+	void           setRenderer(Renderer* renderer);
+
+	/// The snapshot written by the previous simulation step.
+	const RenderSnapshot& getRenderSnapshot() const;
 
 	template<typename... Type>
 	[[nodiscard]] decltype(auto) get(const entt::entity entt)
@@ -48,6 +55,7 @@ public:
 	}
 
 private:
+	Options  options;
 	Scene    mainScene;
 	Window   window;
 	Settings settings;
@@ -55,8 +63,17 @@ private:
 	/// Non owning reference
 	Renderer* activeRenderer;
 
+	// The simulation writes one while the renderer reads the other.
+	std::array<RenderSnapshot, 2> renderSnapshots;
+	int                           writeSnapshot = 0;
+
+	void updateRenderSnapshot();
+	void swapRenderSnapshots();
+
 	entt::basic_scheduler<float> scheduler;
 
+	bool shouldClose(uint32_t frame);
+
 	static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
 	static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
@@ -20,19 +20,29 @@
 
 #include "engine.hpp"
 #include "exePath.hpp"
+#include "math/batch.hpp"
+#include "options.hpp"
 
 int main(int argc, char** argv)
 {
-	if(argc < 2)
+	Options options;
+
+	if(!options.parse(argc, argv))
 	{
-		std::cerr << "Usage: " << argv[0] << " SCENE\n";
+		Options::usage(argv[0]);
 		return EXIT_FAILURE;
 	}
 
+	if(options.benchmarkMath)
+	{
+		math::benchmark(std::cout);
+		return EXIT_SUCCESS;
+	}
+
 	std::cerr << exePath() << '\n';
 
 
-	Engine app(argv[1]);
+	Engine app(options);
 
 	return app.run();
 }
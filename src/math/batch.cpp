@@ -0,0 +1,572 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MATH_X86
+#include <immintrin.h>
+#endif
+
+#include "batch.hpp"
+
+// The kernels only see column major floats.
+static_assert(sizeof(glm::mat4) == 16*sizeof(float));
+
+namespace math
+{
+
+using MultiplyKernel = void(*)(const float* a, const float* b, float* out, size_t count);
+using NormalKernel   = void(*)(const float* m, float* out, size_t count);
+using CullKernel     = uint32_t(*)(const Aabbs& boxes, const float* planes, uint32_t first, uint32_t last, uint32_t* visible);
+
+static void multiplyScalar(const float* a, const float* b, float* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++, a += 16, b += 16, out += 16)
+	{
+		for(size_t col = 0; col < 4; col++)
+		{
+			for(size_t row = 0; row < 4; row++)
+			{
+				out[col*4 + row] =
+					a[0*4 + row] * b[col*4 + 0] +
+					a[1*4 + row] * b[col*4 + 1] +
+					a[2*4 + row] * b[col*4 + 2] +
+					a[3*4 + row] * b[col*4 + 3];
+			}
+		}
+	}
+}
+
+// The inverse transpose of the upper 3x3 is its cofactor matrix divided by the
+// determinant, and the cofactor columns are the cross products of the columns.
+static void normalScalar(const float* m, float* out, size_t count)
+{
+	auto cross = [](const float* a, const float* b, float* c)
+	{
+		c[0] = a[1]*b[2] - a[2]*b[1];
+		c[1] = a[2]*b[0] - a[0]*b[2];
+		c[2] = a[0]*b[1] - a[1]*b[0];
+		c[3] = 0;
+	};
+
+	for(size_t i = 0; i < count; i++, m += 16, out += 16)
+	{
+		cross(m + 4, m + 8, out + 0);
+		cross(m + 8, m + 0, out + 4);
+		cross(m + 0, m + 4, out + 8);
+
+		float invDet = 1.f / (m[0]*out[0] + m[1]*out[1] + m[2]*out[2]);
+
+		for(size_t j = 0; j < 12; j++)
+			out[j] *= invDet;
+
+		out[12] = 0;
+		out[13] = 0;
+		out[14] = 0;
+		out[15] = 1;
+	}
+}
+
+// A box is visible when it's at least partly on the inner side of every plane.
+// NaN centers fail every comparison, so empty boxes are culled too.
+static uint32_t cullScalar(const Aabbs& boxes, const float* planes, uint32_t first, uint32_t last, uint32_t* visible)
+{
+	uint32_t count = 0;
+
+	for(uint32_t i = first; i < last; i++)
+	{
+		bool inside = true;
+
+		for(size_t j = 0; j < 6 && inside; j++)
+		{
+			const float* p = planes + j*4;
+
+			float distance =
+				p[0]*boxes.centerX[i] + p[1]*boxes.centerY[i] + p[2]*boxes.centerZ[i] + p[3] +
+				std::abs(p[0])*boxes.extentX[i] + std::abs(p[1])*boxes.extentY[i] + std::abs(p[2])*boxes.extentZ[i];
+
+			inside = distance >= 0;
+		}
+
+		if(inside)
+			visible[count++] = i;
+	}
+
+	return count;
+}
+
+#ifdef MATH_X86
+
+__attribute__((target("sse4.2")))
+static void multiplySSE42(const float* a, const float* b, float* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++, a += 16, b += 16, out += 16)
+	{
+		__m128 a0 = _mm_loadu_ps(a + 0);
+		__m128 a1 = _mm_loadu_ps(a + 4);
+		__m128 a2 = _mm_loadu_ps(a + 8);
+		__m128 a3 = _mm_loadu_ps(a + 12);
+
+		for(size_t col = 0; col < 4; col++)
+		{
+			const float* bc = b + col*4;
+
+			__m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+			r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+			r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+			r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+
+			_mm_storeu_ps(out + col*4, r);
+		}
+	}
+}
+
+#define YZXW _MM_SHUFFLE(3, 0, 2, 1)
+
+// cross(a, b) = (a * b.yzx - a.yzx * b).yzx, w stays 0 as long as it's finite.
+__attribute__((target("sse4.2")))
+static inline __m128 cross128(__m128 a, __m128 b)
+{
+	__m128 c = _mm_sub_ps(
+		_mm_mul_ps(a, _mm_shuffle_ps(b, b, YZXW)),
+		_mm_mul_ps(_mm_shuffle_ps(a, a, YZXW), b)
+	);
+
+	return _mm_shuffle_ps(c, c, YZXW);
+}
+
+__attribute__((target("sse4.2")))
+static void normalSSE42(const float* m, float* out, size_t count)
+{
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 w   = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+
+	for(size_t i = 0; i < count; i++, m += 16, out += 16)
+	{
+		__m128 c0 = _mm_loadu_ps(m + 0);
+		__m128 c1 = _mm_loadu_ps(m + 4);
+		__m128 c2 = _mm_loadu_ps(m + 8);
+
+		__m128 r0 = cross128(c1, c2);
+		__m128 r1 = cross128(c2, c0);
+		__m128 r2 = cross128(c0, c1);
+
+		// Only xyz are summed.
+		__m128 det    = _mm_dp_ps(c0, r0, 0x7F);
+		__m128 invDet = _mm_div_ps(one, det);
+
+		_mm_storeu_ps(out + 0,  _mm_mul_ps(r0, invDet));
+		_mm_storeu_ps(out + 4,  _mm_mul_ps(r1, invDet));
+		_mm_storeu_ps(out + 8,  _mm_mul_ps(r2, invDet));
+		_mm_storeu_ps(out + 12, w);
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static void multiplyAVX2(const float* a, const float* b, float* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++, a += 16, b += 16, out += 16)
+	{
+		__m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 0));
+		__m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 4));
+		__m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 8));
+		__m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a + 12));
+
+		// Two columns at a time.
+		for(size_t col = 0; col < 4; col += 2)
+		{
+			__m256 bc = _mm256_loadu_ps(b + col*4);
+
+			__m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bc, 0x00));
+			r = _mm256_fmadd_ps(a1, _mm256_permute_ps(bc, 0x55), r);
+			r = _mm256_fmadd_ps(a2, _mm256_permute_ps(bc, 0xAA), r);
+			r = _mm256_fmadd_ps(a3, _mm256_permute_ps(bc, 0xFF), r);
+
+			_mm256_storeu_ps(out + col*4, r);
+		}
+	}
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 cross256(__m256 a, __m256 b)
+{
+	__m256 c = _mm256_fmsub_ps(
+		a, _mm256_permute_ps(b, YZXW),
+		_mm256_mul_ps(_mm256_permute_ps(a, YZXW), b)
+	);
+
+	return _mm256_permute_ps(c, YZXW);
+}
+
+// Same column of two consecutive matrices.
+__attribute__((target("avx2,fma")))
+static inline __m256 load2(const float* lo)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(lo + 16), 1);
+}
+
+__attribute__((target("avx2,fma")))
+static inline void store2(float* lo, __m256 v)
+{
+	_mm_storeu_ps(lo,      _mm256_castps256_ps128(v));
+	_mm_storeu_ps(lo + 16, _mm256_extractf128_ps(v, 1));
+}
+
+// Two matrices at a time, one per 128 bit lane.
+__attribute__((target("avx2,fma")))
+static void normalAVX2(const float* m, float* out, size_t count)
+{
+	const __m256 one = _mm256_set1_ps(1.f);
+	const __m128 w   = _mm_setr_ps(0.f, 0.f, 0.f, 1.f);
+
+	size_t i = 0;
+	for(; i + 2 <= count; i += 2, m += 32, out += 32)
+	{
+		__m256 c0 = load2(m + 0);
+		__m256 c1 = load2(m + 4);
+		__m256 c2 = load2(m + 8);
+
+		__m256 r0 = cross256(c1, c2);
+		__m256 r1 = cross256(c2, c0);
+		__m256 r2 = cross256(c0, c1);
+
+		__m256 det    = _mm256_dp_ps(c0, r0, 0x7F);
+		__m256 invDet = _mm256_div_ps(one, det);
+
+		store2(out + 0, _mm256_mul_ps(r0, invDet));
+		store2(out + 4, _mm256_mul_ps(r1, invDet));
+		store2(out + 8, _mm256_mul_ps(r2, invDet));
+
+		_mm_storeu_ps(out + 12, w);
+		_mm_storeu_ps(out + 28, w);
+	}
+
+	normalSSE42(m, out, count - i);
+}
+
+__attribute__((target("avx512f")))
+static void multiplyAVX512(const float* a, const float* b, float* out, size_t count)
+{
+	for(size_t i = 0; i < count; i++, a += 16, b += 16, out += 16)
+	{
+		__m512 a0 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 0));
+		__m512 a1 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 4));
+		__m512 a2 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 8));
+		__m512 a3 = _mm512_broadcast_f32x4(_mm_loadu_ps(a + 12));
+
+		// The whole matrix at once.
+		__m512 bc = _mm512_loadu_ps(b);
+
+		__m512 r = _mm512_mul_ps(a0, _mm512_permute_ps(bc, 0x00));
+		r = _mm512_fmadd_ps(a1, _mm512_permute_ps(bc, 0x55), r);
+		r = _mm512_fmadd_ps(a2, _mm512_permute_ps(bc, 0xAA), r);
+		r = _mm512_fmadd_ps(a3, _mm512_permute_ps(bc, 0xFF), r);
+
+		_mm512_storeu_ps(out, r);
+	}
+}
+
+#undef YZXW
+
+// Four boxes at a time.
+__attribute__((target("sse4.2")))
+static uint32_t cullSSE42(const Aabbs& boxes, const float* planes, uint32_t first, uint32_t last, uint32_t* visible)
+{
+	const __m128 zero = _mm_setzero_ps();
+
+	uint32_t count = 0;
+	uint32_t i     = first;
+
+	for(; i + 4 <= last; i += 4)
+	{
+		__m128 cx = _mm_loadu_ps(&boxes.centerX[i]);
+		__m128 cy = _mm_loadu_ps(&boxes.centerY[i]);
+		__m128 cz = _mm_loadu_ps(&boxes.centerZ[i]);
+		__m128 ex = _mm_loadu_ps(&boxes.extentX[i]);
+		__m128 ey = _mm_loadu_ps(&boxes.extentY[i]);
+		__m128 ez = _mm_loadu_ps(&boxes.extentZ[i]);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+		for(size_t j = 0; j < 6; j++)
+		{
+			const float* p = planes + j*4;
+
+			__m128 distance = _mm_set1_ps(p[3]);
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(p[0]), cx));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(p[1]), cy));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(p[2]), cz));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::abs(p[0])), ex));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::abs(p[1])), ey));
+			distance = _mm_add_ps(distance, _mm_mul_ps(_mm_set1_ps(std::abs(p[2])), ez));
+
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+		}
+
+		for(int mask = _mm_movemask_ps(inside); mask != 0; mask &= mask - 1)
+			visible[count++] = i + __builtin_ctz(mask);
+	}
+
+	return count + cullScalar(boxes, planes, i, last, visible + count);
+}
+
+// Eight boxes at a time.
+__attribute__((target("avx2,fma")))
+static uint32_t cullAVX2(const Aabbs& boxes, const float* planes, uint32_t first, uint32_t last, uint32_t* visible)
+{
+	const __m256 zero = _mm256_setzero_ps();
+
+	uint32_t count = 0;
+	uint32_t i     = first;
+
+	for(; i + 8 <= last; i += 8)
+	{
+		__m256 cx = _mm256_loadu_ps(&boxes.centerX[i]);
+		__m256 cy = _mm256_loadu_ps(&boxes.centerY[i]);
+		__m256 cz = _mm256_loadu_ps(&boxes.centerZ[i]);
+		__m256 ex = _mm256_loadu_ps(&boxes.extentX[i]);
+		__m256 ey = _mm256_loadu_ps(&boxes.extentY[i]);
+		__m256 ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+		for(size_t j = 0; j < 6; j++)
+		{
+			const float* p = planes + j*4;
+
+			__m256 distance = _mm256_set1_ps(p[3]);
+			distance = _mm256_fmadd_ps(_mm256_set1_ps(p[0]), cx, distance);
+			distance = _mm256_fmadd_ps(_mm256_set1_ps(p[1]), cy, distance);
+			distance = _mm256_fmadd_ps(_mm256_set1_ps(p[2]), cz, distance);
+			distance = _mm256_fmadd_ps(_mm256_set1_ps(std::abs(p[0])), ex, distance);
+			distance = _mm256_fmadd_ps(_mm256_set1_ps(std::abs(p[1])), ey, distance);
+			distance = _mm256_fmadd_ps(_mm256_set1_ps(std::abs(p[2])), ez, distance);
+
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+		}
+
+		for(int mask = _mm256_movemask_ps(inside); mask != 0; mask &= mask - 1)
+			visible[count++] = i + __builtin_ctz(mask);
+	}
+
+	return count + cullScalar(boxes, planes, i, last, visible + count);
+}
+
+// Sixteen boxes at a time, the visible indices are compressed in one store.
+__attribute__((target("avx512f")))
+static uint32_t cullAVX512(const Aabbs& boxes, const float* planes, uint32_t first, uint32_t last, uint32_t* visible)
+{
+	const __m512  zero = _mm512_setzero_ps();
+	const __m512i lane = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+	uint32_t count = 0;
+	uint32_t i     = first;
+
+	for(; i + 16 <= last; i += 16)
+	{
+		__m512 cx = _mm512_loadu_ps(&boxes.centerX[i]);
+		__m512 cy = _mm512_loadu_ps(&boxes.centerY[i]);
+		__m512 cz = _mm512_loadu_ps(&boxes.centerZ[i]);
+		__m512 ex = _mm512_loadu_ps(&boxes.extentX[i]);
+		__m512 ey = _mm512_loadu_ps(&boxes.extentY[i]);
+		__m512 ez = _mm512_loadu_ps(&boxes.extentZ[i]);
+
+		__mmask16 inside = 0xFFFF;
+
+		for(size_t j = 0; j < 6; j++)
+		{
+			const float* p = planes + j*4;
+
+			__m512 distance = _mm512_set1_ps(p[3]);
+			distance = _mm512_fmadd_ps(_mm512_set1_ps(p[0]), cx, distance);
+			distance = _mm512_fmadd_ps(_mm512_set1_ps(p[1]), cy, distance);
+			distance = _mm512_fmadd_ps(_mm512_set1_ps(p[2]), cz, distance);
+			distance = _mm512_fmadd_ps(_mm512_set1_ps(std::abs(p[0])), ex, distance);
+			distance = _mm512_fmadd_ps(_mm512_set1_ps(std::abs(p[1])), ey, distance);
+			distance = _mm512_fmadd_ps(_mm512_set1_ps(std::abs(p[2])), ez, distance);
+
+			inside &= _mm512_cmp_ps_mask(distance, zero, _CMP_GE_OQ);
+		}
+
+		__m512i indices = _mm512_add_epi32(_mm512_set1_epi32(i), lane);
+
+		_mm512_mask_compressstoreu_epi32(visible + count, inside, indices);
+		count += __builtin_popcount(inside);
+	}
+
+	return count + cullScalar(boxes, planes, i, last, visible + count);
+}
+
+#endif
+
+static MultiplyKernel multiplyKernel(Isa isa)
+{
+	switch(isa)
+	{
+#ifdef MATH_X86
+		case Isa::AVX512: return multiplyAVX512;
+		case Isa::AVX2:   return multiplyAVX2;
+		case Isa::SSE42:  return multiplySSE42;
+#endif
+		default:          return multiplyScalar;
+	}
+}
+
+static NormalKernel normalKernel(Isa isa)
+{
+	switch(isa)
+	{
+#ifdef MATH_X86
+		// Four matrices per 512 bit register need more shuffles than they save.
+		case Isa::AVX512:
+		case Isa::AVX2:   return normalAVX2;
+		case Isa::SSE42:  return normalSSE42;
+#endif
+		default:          return normalScalar;
+	}
+}
+
+static CullKernel cullKernel(Isa isa)
+{
+	switch(isa)
+	{
+#ifdef MATH_X86
+		case Isa::AVX512: return cullAVX512;
+		case Isa::AVX2:   return cullAVX2;
+		case Isa::SSE42:  return cullSSE42;
+#endif
+		default:          return cullScalar;
+	}
+}
+
+Isa detectIsa()
+{
+#ifdef MATH_X86
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("avx512f"))
+		return Isa::AVX512;
+
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		return Isa::AVX2;
+
+	if(__builtin_cpu_supports("sse4.2"))
+		return Isa::SSE42;
+#endif
+
+	return Isa::Scalar;
+}
+
+static Isa            currentIsa   = detectIsa();
+static MultiplyKernel multiplyImpl = multiplyKernel(currentIsa);
+static NormalKernel   normalImpl   = normalKernel(currentIsa);
+static CullKernel     cullImpl     = cullKernel(currentIsa);
+
+Isa getIsa()
+{
+	return currentIsa;
+}
+
+void setIsa(Isa isa)
+{
+	assert(isa <= detectIsa());
+
+	currentIsa   = isa;
+	multiplyImpl = multiplyKernel(isa);
+	normalImpl   = normalKernel(isa);
+	cullImpl     = cullKernel(isa);
+}
+
+std::string_view toString(Isa isa)
+{
+	switch(isa)
+	{
+		case Isa::Scalar: return "scalar";
+		case Isa::SSE42:  return "sse4.2";
+		case Isa::AVX2:   return "avx2";
+		case Isa::AVX512: return "avx512";
+	}
+
+	return "unknown";
+}
+
+void multiply(std::span<const glm::mat4> a, std::span<const glm::mat4> b, std::span<glm::mat4> out)
+{
+	assert(a.size() == b.size() && a.size() == out.size());
+
+	multiplyImpl(
+		reinterpret_cast<const float*>(a.data()),
+		reinterpret_cast<const float*>(b.data()),
+		reinterpret_cast<float*>(out.data()),
+		out.size()
+	);
+}
+
+void normalMatrices(std::span<const glm::mat4> m, std::span<glm::mat4> out)
+{
+	assert(m.size() == out.size());
+
+	normalImpl(
+		reinterpret_cast<const float*>(m.data()),
+		reinterpret_cast<float*>(out.data()),
+		out.size()
+	);
+}
+
+
+size_t Aabbs::size() const
+{
+	return centerX.size();
+}
+
+void Aabbs::resize(size_t size)
+{
+	for(auto* v: {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+		v->resize(size);
+}
+
+void Aabbs::set(size_t i, const glm::vec3& center, const glm::vec3& extent)
+{
+	centerX[i] = center.x;
+	centerY[i] = center.y;
+	centerZ[i] = center.z;
+
+	extentX[i] = extent.x;
+	extentY[i] = extent.y;
+	extentZ[i] = extent.z;
+}
+
+void Aabbs::setEmpty(size_t i)
+{
+	constexpr float nan = std::numeric_limits<float>::quiet_NaN();
+
+	set(i, glm::vec3(nan), glm::vec3(0));
+}
+
+uint32_t cullAabbs(const Aabbs& boxes, const std::array<glm::vec4, 6>& planes, uint32_t first, uint32_t last, uint32_t* visible)
+{
+	assert(first <= last && last <= boxes.size());
+
+	static_assert(sizeof(planes) == 24*sizeof(float));
+
+	return cullImpl(boxes, reinterpret_cast<const float*>(planes.data()), first, last, visible);
+}
+
+}
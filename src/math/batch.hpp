@@ -0,0 +1,91 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+/// Matrix kernels over contiguous arrays, the best instruction set the CPU
+/// supports is chosen at runtime.
+namespace math
+{
+
+enum class Isa
+{
+	Scalar,
+	SSE42,
+	AVX2,
+	AVX512
+};
+
+/// Best instruction set supported by this CPU.
+Isa detectIsa();
+
+Isa  getIsa();
+/// Not thread safe, isa must be supported by the CPU.
+void setIsa(Isa isa);
+
+std::string_view toString(Isa isa);
+
+/// out[i] = a[i] * b[i]
+void multiply(std::span<const glm::mat4> a, std::span<const glm::mat4> b, std::span<glm::mat4> out);
+
+/// out[i] = transpose(inverse(m[i])) for affine matrices.
+///
+/// Only the upper 3x3 is computed, it's the only part that transforms
+/// normals. The rest is the identity's, like glm::mat4(glm::mat3(...)).
+void normalMatrices(std::span<const glm::mat4> m, std::span<glm::mat4> out);
+
+/// World space boxes as a structure of arrays.
+struct Aabbs
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+
+	std::vector<float> extentX;
+	std::vector<float> extentY;
+	std::vector<float> extentZ;
+
+	size_t size() const;
+	void   resize(size_t size);
+
+	void set(size_t i, const glm::vec3& center, const glm::vec3& extent);
+
+	/// Boxes without a center are never visible.
+	void setEmpty(size_t i);
+};
+
+/// Writes the indices in [first, last) of the boxes inside the planes to
+/// visible and returns how many there are.
+///
+/// visible must have room for last - first indices.
+uint32_t cullAabbs(const Aabbs& boxes, const std::array<glm::vec4, 6>& planes, uint32_t first, uint32_t last, uint32_t* visible);
+
+/// Times every supported instruction set against the scalar one and writes the
+/// results as JSON.
+void benchmark(std::ostream& os);
+
+}
@@ -0,0 +1,184 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "batch.hpp"
+#include "frustum.hpp"
+
+namespace math
+{
+
+static constexpr size_t COUNT = 100000;
+static constexpr size_t RUNS  = 50;
+
+/// Best run in nanoseconds per matrix.
+template<typename F>
+static double time(F&& f)
+{
+	double best = INFINITY;
+
+	for(size_t i = 0; i < RUNS; i++)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		f();
+
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count() / COUNT);
+	}
+
+	return best;
+}
+
+static float maxError(std::span<const glm::mat4> a, std::span<const glm::mat4> b)
+{
+	float error = 0;
+
+	for(size_t i = 0; i < a.size(); i++)
+	{
+		for(int col = 0; col < 4; col++)
+		{
+			for(int row = 0; row < 4; row++)
+				error = std::max(error, std::abs(a[i][col][row] - b[i][col][row]));
+		}
+	}
+
+	return error;
+}
+
+void benchmark(std::ostream& os)
+{
+	const Isa best = detectIsa();
+
+	// Random TRS matrices, like the ones in the scene.
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> position(-100.f, 100.f);
+	std::uniform_real_distribution<float> angle(-3.14f, 3.14f);
+	std::uniform_real_distribution<float> scale(0.1f, 10.f);
+
+	std::vector<glm::mat4> a(COUNT), b(COUNT);
+	std::vector<glm::mat4> expectedProduct(COUNT), expectedNormal(COUNT);
+	std::vector<glm::mat4> glmProduct(COUNT), glmNormal(COUNT);
+	std::vector<glm::mat4> product(COUNT), normal(COUNT);
+
+	Aabbs boxes;
+	boxes.resize(COUNT);
+
+	std::vector<uint32_t> expectedVisible(COUNT), visible(COUNT);
+
+	for(auto* m: {&a, &b})
+	{
+		for(auto& matrix: *m)
+		{
+			glm::quat rotation(glm::vec3(angle(gen), angle(gen), angle(gen)));
+
+			matrix =
+				glm::translate(glm::mat4(1), {position(gen), position(gen), position(gen)}) *
+				glm::mat4_cast(rotation) *
+				glm::scale(glm::mat4(1), {scale(gen), scale(gen), scale(gen)});
+		}
+	}
+
+	std::uniform_real_distribution<float> extent(0.1f, 5.f);
+
+	for(size_t i = 0; i < COUNT; i++)
+	{
+		// Some free slots
+		if(i % 10 == 0)
+			boxes.setEmpty(i);
+		else
+			boxes.set(i, {position(gen), position(gen), position(gen)}, {extent(gen), extent(gen), extent(gen)});
+	}
+
+	auto planes = frustumPlanes(
+		glm::perspective(glm::radians(45.f), 16.f/9, 0.1f, 100.f) *
+		glm::lookAt(glm::vec3(0), glm::vec3(1, 0, 0), glm::vec3(0, 1, 0))
+	);
+
+	// Reference for every kernel, the scalar one included.
+	for(size_t i = 0; i < COUNT; i++)
+	{
+		glmProduct[i] = a[i] * b[i];
+		glmNormal[i]  = glm::mat4(glm::transpose(glm::inverse(glm::mat3(a[i]))));
+	}
+
+	setIsa(Isa::Scalar);
+	multiply(a, b, expectedProduct);
+	normalMatrices(a, expectedNormal);
+
+	uint32_t expectedCount = cullAabbs(boxes, planes, 0, COUNT, expectedVisible.data());
+
+	double scalarMultiply = time([&]{multiply(a, b, product);});
+	double scalarNormal   = time([&]{normalMatrices(a, normal);});
+	double scalarCull     = time([&]{cullAabbs(boxes, planes, 0, COUNT, visible.data());});
+
+	os
+		<< std::boolalpha
+		<< "{\n"
+		<< "\t\"matrices\": " << COUNT << ",\n"
+		<< "\t\"runs\": "     << RUNS << ",\n"
+		<< "\t\"visible\": "  << expectedCount << ",\n"
+		<< "\t\"unit\": \"ns/element\",\n"
+		<< "\t\"kernels\": [\n"
+	;
+
+	for(Isa isa = Isa::Scalar; isa <= best; isa = Isa((int)isa + 1))
+	{
+		setIsa(isa);
+
+		double multiplyTime = time([&]{multiply(a, b, product);});
+		double normalTime   = time([&]{normalMatrices(a, normal);});
+		double cullTime     = time([&]{cullAabbs(boxes, planes, 0, COUNT, visible.data());});
+
+		uint32_t count = cullAabbs(boxes, planes, 0, COUNT, visible.data());
+
+		bool cullMatches = count == expectedCount && std::equal(visible.begin(), visible.begin() + count, expectedVisible.begin());
+
+		os
+			<< "\t\t{"
+			<< "\"isa\": \""           << toString(isa) << "\", "
+			<< "\"multiply\": "        << multiplyTime << ", "
+			<< "\"multiplySpeedup\": " << scalarMultiply / multiplyTime << ", "
+			<< "\"multiplyError\": "   << maxError(product, expectedProduct) << ", "
+			<< "\"multiplyGlmError\": " << maxError(product, glmProduct) << ", "
+			<< "\"normal\": "          << normalTime << ", "
+			<< "\"normalSpeedup\": "   << scalarNormal / normalTime << ", "
+			<< "\"normalError\": "     << maxError(normal, expectedNormal) << ", "
+			<< "\"normalGlmError\": "  << maxError(normal, glmNormal) << ", "
+			<< "\"cull\": "            << cullTime << ", "
+			<< "\"cullSpeedup\": "     << scalarCull / cullTime << ", "
+			<< "\"cullMatches\": "     << cullMatches << "}"
+			<< (isa == best ? "\n" : ",\n")
+		;
+	}
+
+	os
+		<< "\t]\n"
+		<< "}\n"
+	;
+
+	setIsa(best);
+}
+
+}
@@ -0,0 +1,49 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <glm/geometric.hpp>
+#include <glm/gtc/matrix_access.hpp>
+
+#include "frustum.hpp"
+
+namespace math
+{
+
+std::array<glm::vec4, 6> frustumPlanes(const glm::mat4& projView)
+{
+	const glm::vec4 r0 = glm::row(projView, 0);
+	const glm::vec4 r1 = glm::row(projView, 1);
+	const glm::vec4 r2 = glm::row(projView, 2);
+	const glm::vec4 r3 = glm::row(projView, 3);
+
+	// Clip space depth goes from 0 to 1.
+	std::array<glm::vec4, 6> planes =
+	{
+		r3 + r0,
+		r3 - r0,
+		r3 + r1,
+		r3 - r1,
+		r2,
+		r3 - r2
+	};
+
+	for(auto& plane: planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return planes;
+}
+
+}
@@ -0,0 +1,33 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+
+namespace math
+{
+
+/// Left, right, bottom, top, near and far planes of a Vulkan projection.
+///
+/// Normals point inside and are normalized, so dot(plane.xyz, p) + plane.w is
+/// the signed distance of p.
+std::array<glm::vec4, 6> frustumPlanes(const glm::mat4& projView);
+
+}
@@ -82,66 +82,16 @@ void Mesh::clear()
 	indices.clear();
 }
 
-bool Mesh::uploadToGpu(Renderer& root)
+UploadToken Mesh::uploadToGpu(Renderer& root)
 {
-	vertexBuffer = uploadVertices(root);
-	indexBuffer  = uploadIndices(root);
+	// The old ranges may still be used by a frame in flight.
+	root.frameData.destroyLater(std::move(vertexRange));
+	root.frameData.destroyLater(std::move(indexRange));
 
-	return true;
-}
-
-Buffer Mesh::uploadVertices(Renderer& root) const
-{
-	using enum vk::BufferUsageFlagBits;
-	using enum vk::MemoryPropertyFlagBits;
-
-	vk::DeviceSize bufferSize = sizeof(decltype(vertices)::value_type) * vertices.size();
-
-	Buffer stagingBuffer = root.allocator.createBuffer(
-		bufferSize,
-		eTransferSrc,
-		eHostVisible | eHostCoherent
-	);
-
-	memcpy(stagingBuffer.allocationInfo.pMappedData, vertices.data(), (size_t)bufferSize);
-	stagingBuffer.flush();
-
-	Buffer vertexBuffer = root.allocator.createBuffer(
-		bufferSize,
-		eTransferDst | eVertexBuffer,
-		eDeviceLocal
-	);
-
-	root.copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-	return vertexBuffer;
-}
+	vertexRange = root.geometry.uploadVertices(vertices);
+	indexRange  = root.geometry.uploadIndices(indices);
 
-Buffer Mesh::uploadIndices(Renderer& root) const
-{
-	using enum vk::BufferUsageFlagBits;
-	using enum vk::MemoryPropertyFlagBits;
-
-	vk::DeviceSize bufferSize = sizeof(decltype(indices)::value_type) * indices.size();
-
-	Buffer stagingBuffer = root.allocator.createBuffer(
-		bufferSize,
-		eTransferSrc,
-		eHostVisible | eHostCoherent
-	);
-
-	memcpy(stagingBuffer.allocationInfo.pMappedData, indices.data(), (size_t) bufferSize);
-	stagingBuffer.flush();
-
-	Buffer indexBuffer = root.allocator.createBuffer(
-		bufferSize,
-		eTransferDst | eIndexBuffer,
-		eDeviceLocal
-	);
-
-	root.copyBuffer(stagingBuffer, indexBuffer, bufferSize);
-
-	return indexBuffer;
+	return root.uploads.getPendingToken();
 }
 
 std::span<Vertex> Mesh::getVertices()
@@ -164,12 +114,17 @@ std::span<const uint32_t> Mesh::getIndices() const
 	return indices;
 }
 
-const vk::Buffer Mesh::getVertexBuffer() const
+int32_t Mesh::getVertexOffset() const
+{
+	return vertexRange.offset;
+}
+
+uint32_t Mesh::getFirstIndex() const
 {
-	return vertexBuffer.buffer;
+	return indexRange.offset;
 }
 
-const vk::Buffer Mesh::getIndexBuffer() const
+uint32_t Mesh::getIndexCount() const
 {
-	return indexBuffer.buffer;
+	return indexRange.count;
 }
@@ -20,7 +20,8 @@
 #include <vulkan/vulkan_raii.hpp>
 
 #include "vertex.hpp"
-#include "vulkan/allocator.hpp"
+#include "vulkan/geometryBuffer.hpp"
+#include "vulkan/uploadManager.hpp"
 
 #pragma once
 
@@ -33,8 +34,8 @@ struct Mesh
 	std::vector<Vertex>   vertices;
 	std::vector<uint32_t> indices;
 
-	Buffer vertexBuffer;
-	Buffer indexBuffer;
+	GeometryRange vertexRange;
+	GeometryRange indexRange;
 
 	glm::vec3 aabbMin;
 	glm::vec3 aabbMax;
@@ -43,15 +44,13 @@ struct Mesh
 	void loadVertices(const aiMesh& mesh);
 	void loadIndices(const aiMesh& mesh);
 
-	Buffer uploadVertices(Renderer& root) const;
-	Buffer uploadIndices(Renderer& root) const;
-
 	Mesh(const aiMesh& mesh);
 
 	bool load();
 	void clear();
 
-	bool uploadToGpu(Renderer& root);
+	/// Done when the returned token is, see UploadManager.
+	UploadToken uploadToGpu(Renderer& root);
 
 	std::span<Vertex>       getVertices();
 	std::span<const Vertex> getVertices() const;
@@ -59,6 +58,8 @@ struct Mesh
 	std::span<uint32_t>       getIndices();
 	std::span<const uint32_t> getIndices() const;
 
-	const vk::Buffer getVertexBuffer() const;
-	const vk::Buffer getIndexBuffer() const;
+	/// Where the mesh is in the geometry buffer.
+	int32_t  getVertexOffset() const;
+	uint32_t getFirstIndex() const;
+	uint32_t getIndexCount() const;
 };
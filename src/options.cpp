@@ -0,0 +1,116 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdlib>
+#include <getopt.h>
+#include <iostream>
+
+#include "options.hpp"
+
+bool Options::parse(int argc, char** argv)
+{
+	enum
+	{
+		HEADLESS = 256,
+		FRAMES,
+		BENCHMARK,
+		WARMUP,
+		DELTA,
+		OUTPUT,
+		BENCHMARK_MATH,
+	};
+
+	const option longOptions[] =
+	{
+		{"headless",       no_argument,       nullptr, HEADLESS},
+		{"frames",         required_argument, nullptr, FRAMES},
+		{"benchmark",      no_argument,       nullptr, BENCHMARK},
+		{"warmup",         required_argument, nullptr, WARMUP},
+		{"delta",          required_argument, nullptr, DELTA},
+		{"output",         required_argument, nullptr, OUTPUT},
+		{"benchmark-math", no_argument,       nullptr, BENCHMARK_MATH},
+		{nullptr,          0,                 nullptr, 0}
+	};
+
+	int c;
+	while((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1)
+	{
+		switch(c)
+		{
+			case HEADLESS:
+				headless = true;
+				break;
+
+			case FRAMES:
+				frames = std::strtoul(optarg, nullptr, 10);
+				break;
+
+			case BENCHMARK:
+				benchmark = true;
+				break;
+
+			case WARMUP:
+				warmup = std::strtoul(optarg, nullptr, 10);
+				break;
+
+			case DELTA:
+				delta = std::strtof(optarg, nullptr);
+				break;
+
+			case OUTPUT:
+				output = optarg;
+				break;
+
+			case BENCHMARK_MATH:
+				benchmarkMath = true;
+				break;
+
+			default:
+				return false;
+		}
+	}
+
+	// It doesn't need a scene.
+	if(benchmarkMath)
+		return optind == argc;
+
+	if(optind != argc - 1)
+		return false;
+
+	scene = argv[optind];
+
+	if(benchmark && frames == 0)
+		frames = 600;
+
+	return true;
+}
+
+void Options::usage(const char* program)
+{
+	std::cerr
+		<< "Usage: " << program << " [OPTION]... SCENE\n"
+		<< "  or:  " << program << " --benchmark-math\n"
+		<< "\n"
+		<< "  --headless      render offscreen, without a window\n"
+		<< "  --frames=N      exit after N frames\n"
+		<< "  --benchmark     measure N frames and report their times as JSON\n"
+		<< "  --warmup=N      frames to run before measuring, 60 by default\n"
+		<< "  --delta=SECONDS fixed simulation step when benchmarking\n"
+		<< "  --output=FILE   write the benchmark report to FILE\n"
+		<< "  --benchmark-math\n"
+		<< "                  time the matrix kernels of every instruction set\n"
+	;
+}
@@ -0,0 +1,52 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+
+/// Command line options.
+struct Options
+{
+	std::filesystem::path scene;
+
+	/// Render into offscreen images, without a window or a surface.
+	bool headless = false;
+
+	/// Frames to run before exiting, 0 runs until the window is closed.
+	uint32_t frames = 0;
+
+	/// Run a fixed number of frames with a fixed delta and report frame times.
+	bool benchmark = false;
+
+	/// Benchmark frames that are run but not measured.
+	uint32_t warmup = 60;
+
+	/// Simulated seconds per frame when benchmarking.
+	float delta = 1.f/60;
+
+	/// Benchmark the batched matrix kernels of every instruction set and exit.
+	bool benchmarkMath = false;
+
+	/// Where the benchmark report is written, stdout if empty.
+	std::filesystem::path output;
+
+	/// Returns false if the arguments are invalid.
+	bool parse(int argc, char** argv);
+
+	static void usage(const char* program);
+};
@@ -0,0 +1,141 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "component/meshInstance.hpp"
+#include "component/worldTransform.hpp"
+#include "renderList.hpp"
+
+bool Renderable::empty() const
+{
+	return mesh == EMPTY;
+}
+
+uint32_t RenderList::allocate()
+{
+	if(!freeSlots.empty())
+	{
+		uint32_t slot = freeSlots.back();
+		freeSlots.pop_back();
+
+		return slot;
+	}
+
+	slots.emplace_back();
+	dirty.push_back(false);
+
+	return slots.size() - 1;
+}
+
+void RenderList::markDirty(uint32_t slot)
+{
+	if(!dirty[slot])
+	{
+		dirty[slot] = true;
+		dirtySlots.push_back(slot);
+	}
+}
+
+void RenderList::onConstruct(entt::registry& registry, entt::entity entity)
+{
+	using namespace ecs::component;
+
+	auto& meshInstance = registry.get<MeshInstance>(entity);
+	auto* world        = registry.try_get<WorldTransform>(entity);
+
+	meshInstance.slots.clear();
+
+	for(uint32_t mesh: meshInstance.meshes)
+	{
+		uint32_t slot = allocate();
+
+		slots[slot].transform = world ? world->matrix : glm::mat4(1);
+		slots[slot].mesh      = mesh;
+
+		meshInstance.slots.push_back(slot);
+		markDirty(slot);
+	}
+}
+
+void RenderList::onDestroy(entt::registry& registry, entt::entity entity)
+{
+	using namespace ecs::component;
+
+	for(uint32_t slot: registry.get<MeshInstance>(entity).slots)
+	{
+		slots[slot] = Renderable();
+
+		freeSlots.push_back(slot);
+		markDirty(slot);
+	}
+}
+
+void RenderList::onUpdate(entt::registry& registry, entt::entity entity)
+{
+	using namespace ecs::component;
+
+	auto* meshInstance = registry.try_get<MeshInstance>(entity);
+
+	if(meshInstance == nullptr)
+		return;
+
+	const auto& world = registry.get<WorldTransform>(entity);
+
+	for(uint32_t slot: meshInstance->slots)
+	{
+		slots[slot].transform = world.matrix;
+		markDirty(slot);
+	}
+}
+
+std::span<const Renderable> RenderList::getSlots() const
+{
+	return slots;
+}
+
+void RenderList::sync(RenderSnapshot& write, const RenderSnapshot& previous)
+{
+	// Trailing free slots are dropped, so the object buffers can shrink.
+	if(!slots.empty() && slots.back().empty())
+	{
+		while(!slots.empty() && slots.back().empty())
+		{
+			slots.pop_back();
+			dirty.pop_back();
+		}
+
+		uint32_t size = slots.size();
+
+		std::erase_if(freeSlots,  [size](uint32_t slot){return slot >= size;});
+		std::erase_if(dirtySlots, [size](uint32_t slot){return slot >= size;});
+	}
+
+	write.renderables.resize(slots.size());
+
+	for(uint32_t slot: previous.dirty)
+	{
+		if(slot < slots.size())
+			write.renderables[slot] = slots[slot];
+	}
+
+	for(uint32_t slot: dirtySlots)
+	{
+		write.renderables[slot] = slots[slot];
+		dirty[slot] = false;
+	}
+
+	write.dirty.assign(dirtySlots.begin(), dirtySlots.end());
+	dirtySlots.clear();
+}
@@ -0,0 +1,79 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <entt/entt.hpp>
+#include <glm/mat4x4.hpp>
+
+struct Renderable
+{
+	static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+	glm::mat4 transform;
+
+	// Index in Scene::meshes, EMPTY for free slots.
+	uint32_t mesh = EMPTY;
+	// Material& material;
+
+	bool empty() const;
+};
+
+/// Everything the renderer needs from the simulation for one frame.
+struct RenderSnapshot
+{
+	std::vector<Renderable> renderables;
+
+	// Slots that changed since the previous snapshot.
+	std::vector<uint32_t> dirty;
+};
+
+/// Renderables kept up to date by registry signals.
+///
+/// Slots are stable, a slot is also the index of the object in the storage
+/// buffer.
+class RenderList
+{
+private:
+	std::vector<Renderable> slots;
+	std::vector<uint32_t>   freeSlots;
+
+	std::vector<uint32_t> dirtySlots;
+	std::vector<uint8_t>  dirty;
+
+	uint32_t allocate();
+	void     markDirty(uint32_t slot);
+
+public:
+	// MeshInstance
+	void onConstruct(entt::registry& registry, entt::entity entity);
+	void onDestroy(entt::registry& registry, entt::entity entity);
+
+	// WorldTransform
+	void onUpdate(entt::registry& registry, entt::entity entity);
+
+	std::span<const Renderable> getSlots() const;
+
+	/// Brings write up to date, previous must be the snapshot written before it.
+	///
+	/// Only the slots that changed in the last two steps are copied.
+	void sync(RenderSnapshot& write, const RenderSnapshot& previous);
+};
@@ -24,8 +24,11 @@
 #include "component/meshInstance.hpp"
 #include "component/properties.hpp"
 #include "component/transform.hpp"
+#include "component/worldTransform.hpp"
+#include "math/batch.hpp"
 #include "scene.hpp"
 #include "utils.hpp"
+#include "vulkan/renderer.hpp"
 
 Scene::Scene(const std::filesystem::path& scenePath)
 {
@@ -49,8 +52,16 @@ Scene::Scene(const std::filesystem::path& scenePath)
 	entt::sigh_helper{registry}
 		.with<Transform>()
 			.on_construct<&entt::registry::emplace<Transform::Relationship>>()
+			.on_construct<&entt::registry::emplace<WorldTransform>>()
+			.on_construct<&entt::registry::emplace_or_replace<Transform::Dirty>>()
+			.on_update<&entt::registry::emplace_or_replace<Transform::Dirty>>()
 		.with<Transform::Relationship>()
 			.on_destroy<&Scene::updateHierarchy>()
+		.with<MeshInstance>()
+			.on_construct<&RenderList::onConstruct>(renderList)
+			.on_destroy<&RenderList::onDestroy>(renderList)
+		.with<WorldTransform>()
+			.on_update<&RenderList::onUpdate>(renderList)
 	;
 
 	loadMeshes({scene->mMeshes, scene->mNumMeshes});
@@ -119,42 +130,76 @@ entt::entity Scene::loadHierarchy(const aiNode* node, entt::entity parent)
 	return entity;
 }
 
-std::vector<Renderable> Scene::getRenderables() const
+void Scene::updateWorldTransforms()
 {
 	using namespace ecs::component;
 
-	std::vector<Renderable> renderables;
-	auto view = registry.view<MeshInstance>();
+	auto dirty = registry.view<Transform::Dirty>();
 
-	for(entt::entity entity: view)
+	level.clear();
+	parentMatrices.clear();
+
+	for(entt::entity entity: dirty)
 	{
-		glm::mat4 matrix(1);
+		entt::entity parent = pGroup.get<Transform::Relationship>(entity).parent;
+
+		// Dirty descendants are updated with their topmost dirty ancestor.
+		bool ancestorDirty = false;
 
-		for(auto e = entity; e != entt::null; e = pGroup.get<Transform::Relationship>(e).parent)
+		for(auto e = parent; e != entt::null && !ancestorDirty; e = pGroup.get<Transform::Relationship>(e).parent)
 		{
-			matrix = pGroup.get<Transform>(e).matrix * matrix;
+			ancestorDirty = dirty.contains(e);
 		}
 
-		for(auto i: view.get<MeshInstance>(entity).meshes)
+		if(ancestorDirty)
+			continue;
+
+		level.push_back(entity);
+		parentMatrices.push_back(parent == entt::null ? glm::mat4(1) : registry.get<WorldTransform>(parent).matrix);
+	}
+
+	// Breadth first, so every depth is a single batch.
+	while(!level.empty())
+	{
+		localMatrices.clear();
+
+		for(entt::entity entity: level)
+			localMatrices.push_back(pGroup.get<Transform>(entity).matrix);
+
+		worldMatrices.resize(level.size());
+		math::multiply(parentMatrices, localMatrices, worldMatrices);
+
+		nextLevel.clear();
+		parentMatrices.clear();
+
+		for(size_t i = 0; i < level.size(); i++)
 		{
-			renderables.emplace_back(
-				matrix,
-				meshes[i].getVertexBuffer(),
-				meshes[i].getIndexBuffer(),
-				meshes[i].getIndices().size()
-			);
+			registry.patch<WorldTransform>(level[i], [&](WorldTransform& worldTransform)
+			{
+				worldTransform.matrix = worldMatrices[i];
+			});
+
+			for(entt::entity child: pGroup.get<Transform::Relationship>(level[i]).children)
+			{
+				nextLevel.push_back(child);
+				parentMatrices.push_back(worldMatrices[i]);
+			}
 		}
+
+		std::swap(level, nextLevel);
 	}
 
-	return renderables;
+	registry.clear<Transform::Dirty>();
 }
 
-void Scene::uploadToGpu(Renderer& renderer)
+UploadToken Scene::uploadToGpu(Renderer& renderer)
 {
 	for(auto& mesh: meshes)
 	{
 		mesh.uploadToGpu(renderer);
 	}
+
+	return renderer.uploads.submit();
 }
 
 void Scene::updateHierarchy(entt::registry& registry, entt::entity entity)
@@ -178,5 +223,8 @@ void Scene::updateHierarchy(entt::registry& registry, entt::entity entity)
 		auto&& [children] = trView.get(e);
 
 		children.parent = self.parent;
+
+		// The parent changed, so the world transform did too.
+		registry.emplace_or_replace<Transform::Dirty>(e);
 	}
 }
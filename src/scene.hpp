@@ -24,21 +24,13 @@
 
 #include "component/transform.hpp"
 #include "mesh.hpp"
+#include "renderList.hpp"
 #include "utils.hpp"
 
 class Renderer;
 struct aiMesh;
 struct aiNode;
 
-struct Renderable
-{
-	glm::mat4  transform;
-	vk::Buffer vertexBuffer;
-	vk::Buffer indexBuffer;
-	uint32_t   indexCount;
-	// Material& material;
-};
-
 struct Scene
 {
 	using Transform = ecs::component::Transform;
@@ -49,15 +41,28 @@ struct Scene
 	std::string name;
 	entt::entity root = entt::null;
 
+	// Outlives the registry, it is connected to its signals.
+	RenderList renderList;
+
 	entt::registry    registry;
 	std::vector<Mesh> meshes;
 
 	const pgroup_t pGroup = registry.group<const Transform, const Transform::Relationship>();
 
-	std::vector<Renderable> getRenderables() const;
-	void uploadToGpu(Renderer& renderer);
+	/// Every mesh in one batch, frames wait for it on the GPU.
+	UploadToken uploadToGpu(Renderer& renderer);
+
+	/// Recomputes the world transforms of the subtrees that moved.
+	void updateWorldTransforms();
 
 private:
+	// Scratch space of updateWorldTransforms(), kept to avoid allocating every frame.
+	std::vector<entt::entity> level;
+	std::vector<entt::entity> nextLevel;
+	std::vector<glm::mat4>    parentMatrices;
+	std::vector<glm::mat4>    localMatrices;
+	std::vector<glm::mat4>    worldMatrices;
+
 	void loadMeshes(const std::span<aiMesh*> newMeshes);
 
 	entt::entity loadHierarchy(const aiNode* node, entt::entity parent);
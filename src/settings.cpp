@@ -23,11 +23,5 @@ void Settings::flush()
 
 bool Settings::hasChanged()
 {
-	if(changed)
-	{
-		changed = false;
-		return true;
-	}
-	else
-		return false;
+	return changed.exchange(false);
 }
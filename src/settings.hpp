@@ -16,13 +16,16 @@
 
 #pragma once
 
+#include <atomic>
+
+// Written by the game systems and read by the renderer concurrently.
 struct Settings
 {
 private:
-	bool changed = false;
+	std::atomic<bool> changed = false;
 
 public:
-	bool vsync = false;
+	std::atomic<bool> vsync = false;
 
 	void flush();
 	bool hasChanged();
@@ -29,7 +29,7 @@ Game::Game(Engine& engine):
 
 void Game::init()
 {
-	std::cout << "Game started\n";
+	std::cerr << "Game started\n";
 
 	// Asign more systems here:
 	scheduler.attach<Mawaru>(engine);
@@ -39,18 +39,25 @@ void Mawaru::update(float delta, void*)
 {
 	using namespace ecs::component;
 
-	auto& transform = engine.get<Transform>(engine.getActiveScene().root);
+	auto& scene = engine.getActiveScene();
 
 	float rotation = delta * input.getAxis().x * glm::radians(rotationSpeed);
 
-	transform.matrix = glm::rotate(transform.matrix, rotation, glm::vec3(0, 1, 0));
+	// Patching marks the whole hierarchy as dirty.
+	if(rotation != 0)
+	{
+		scene.registry.patch<Transform>(scene.root, [rotation](Transform& transform)
+		{
+			transform.matrix = glm::rotate(transform.matrix, rotation, glm::vec3(0, 1, 0));
+		});
+	}
 
 	if(input.space())
 	{
 		if(!spacePressed)
 		{
 			spacePressed = true;
-			std::cout << "Click\n";
+			std::cerr << "Click\n";
 
 			engine.getSettings().vsync = !engine.getSettings().vsync;
 			engine.getSettings().flush();
@@ -58,7 +58,7 @@ void Physics::init()
 {
 	using namespace ecs::component;
 
-	std::cout << "Physics started\n";
+	std::cerr << "Physics started\n";
 
 	collisionConfiguration = std::make_unique<btDefaultCollisionConfiguration>();
 	dispatcher             = std::make_unique<btCollisionDispatcher>(collisionConfiguration.get());
@@ -110,6 +110,7 @@ void Physics::init()
 		auto* body = new btRigidBody(rbInfo);
 
 		body->setUserPointer(&transform);
+		body->setUserIndex((int)entt::to_integral(entity));
 
 		//add the body to the dynamics world
 		world->addRigidBody(body);
@@ -126,11 +127,20 @@ void Physics::update(float delta, void* sbf_p)
 
 	// TODO: Update physics transform from world transform
 
-	sbf->for_each_index(world->getNumCollisionObjects()-1, -1, -1,
-		[this](int i){
+	// Static and sleeping bodies keep their transform.
+	auto moved = [](const btCollisionObject* obj)
+	{
+		return !obj->isStaticObject() && obj->isActive();
+	};
+
+	tf::Task sync = sbf->for_each_index(world->getNumCollisionObjects()-1, -1, -1,
+		[this, moved](int i){
 		btCollisionObject* obj  = world->getCollisionObjectArray()[i];
 		btRigidBody*       body = btRigidBody::upcast(obj);
 
+		if(!moved(obj))
+			return;
+
 		btTransform _transform;
 		if(body && body->getMotionState())
 		{
@@ -145,6 +155,21 @@ void Physics::update(float delta, void* sbf_p)
 
 		_transform.getOpenGLMatrix(glm::value_ptr(transform->matrix));
 	});
+
+	// Signals aren't thread safe, so the moved transforms are marked afterwards.
+	tf::Task markDirty = sbf->emplace([this, moved](){
+		auto& registry = engine.getActiveScene().registry;
+
+		for(int i = 0; i < world->getNumCollisionObjects(); i++)
+		{
+			const btCollisionObject* obj = world->getCollisionObjectArray()[i];
+
+			if(moved(obj))
+				registry.patch<Transform>(static_cast<entt::entity>(obj->getUserIndex()));
+		}
+	});
+
+	sync.precede(markDirty);
 }
 
 }
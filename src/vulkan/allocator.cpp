@@ -14,6 +14,7 @@
 // You should have received a copy of the GNU General Public License
 // along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <stdexcept>
 #include <utility>
 
 #include "allocator.hpp"
@@ -49,9 +50,14 @@ Buffer::operator vk::Buffer&()
 	return buffer;
 }
 
-vk::Result Buffer::flush()
+vk::Result Buffer::flush(vk::DeviceSize offset, vk::DeviceSize size)
 {
-	return (vk::Result)vmaFlushAllocation(allocatorRef, allocation, 0, VK_WHOLE_SIZE);
+	return (vk::Result)vmaFlushAllocation(allocatorRef, allocation, offset, size);
+}
+
+vk::Result Buffer::invalidate(vk::DeviceSize offset, vk::DeviceSize size)
+{
+	return (vk::Result)vmaInvalidateAllocation(allocatorRef, allocation, offset, size);
 }
 
 void Buffer::clear()
@@ -64,6 +70,46 @@ void Buffer::clear()
 	allocatorRef = nullptr;
 }
 
+Image::Image(Image&& other) noexcept:
+	image(std::exchange(other.image,                   {})),
+	allocation(std::exchange(other.allocation,         {})),
+	allocationInfo(std::exchange(other.allocationInfo, {})),
+	allocatorRef(std::exchange(other.allocatorRef,     {}))
+{}
+
+Image& Image::operator=(Image&& other) noexcept
+{
+	if(this != &other)
+	{
+		std::swap(image,          other.image);
+		std::swap(allocation,     other.allocation);
+		std::swap(allocationInfo, other.allocationInfo);
+		std::swap(allocatorRef,   other.allocatorRef);
+	}
+
+	return *this;
+}
+
+Image::~Image()
+{
+	clear();
+}
+
+Image::operator vk::Image&()
+{
+	return image;
+}
+
+void Image::clear()
+{
+	if(image)
+		vmaDestroyImage(allocatorRef, image, allocation);
+
+	image        = nullptr;
+	allocation   = nullptr;
+	allocatorRef = nullptr;
+}
+
 Allocator::Allocator(Renderer& root):
 	root(root)
 {
@@ -71,6 +117,9 @@ Allocator::Allocator(Renderer& root):
 
 Allocator::~Allocator()
 {
+	for(auto [memoryType, pool]: hostPools)
+		vmaDestroyPool(allocator, pool);
+
 	vmaDestroyAllocator(allocator);
 }
 
@@ -84,7 +133,7 @@ void Allocator::create()
 
 	VmaAllocatorCreateInfo allocatorCreateInfo
 	{
-		.flags            = {},
+		.flags            = root.memoryBudget ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0u,
 		.physicalDevice   = *root.physicalDevice,
 		.device           = *root.device,
 		.pVulkanFunctions = &vulkanFunctions,
@@ -98,7 +147,8 @@ void Allocator::create()
 Buffer Allocator::createBuffer(
 	vk::DeviceSize size,
 	vk::BufferUsageFlags usage,
-	vk::MemoryPropertyFlags properties
+	MemoryUsage memoryUsage,
+	std::span<const uint32_t> queueFamilies
 )
 {
 	Buffer buffer;
@@ -107,30 +157,101 @@ Buffer Allocator::createBuffer(
 
 	vk::BufferCreateInfo bufferInfo({}, size, usage, vk::SharingMode::eExclusive);
 
+	if(queueFamilies.size() > 1)
+	{
+		bufferInfo.sharingMode = vk::SharingMode::eConcurrent;
+		bufferInfo.setQueueFamilyIndices(queueFamilies);
+	}
+
 	VkBufferCreateInfo _bufferInfo = bufferInfo;
 	VkBuffer _buffer;
 
 	VmaAllocationCreateInfo allocCreateInfo = {};
-	allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
-	allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
-		VMA_ALLOCATION_CREATE_MAPPED_BIT;
 
-	vmaCreateBuffer(allocator, &_bufferInfo, &allocCreateInfo, &_buffer, &buffer.allocation, &buffer.allocationInfo);
+	switch(memoryUsage)
+	{
+		case MemoryUsage::GpuOnly:
+			allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+			break;
+
+		case MemoryUsage::Upload:
+			allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+			allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+				VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			break;
+
+		// Device local and host visible memory when there is some, the GPU
+		// reads it more often than the CPU writes it.
+		case MemoryUsage::Dynamic:
+			allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+			allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+				VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			break;
+
+		case MemoryUsage::Staged:
+			allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+			allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+				VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT |
+				VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			break;
+
+		// Cached memory, uncached reads are very slow.
+		case MemoryUsage::Readback:
+			allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+			allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT |
+				VMA_ALLOCATION_CREATE_MAPPED_BIT;
+			break;
+	}
+
+	if(memoryUsage == MemoryUsage::Dynamic || memoryUsage == MemoryUsage::Readback)
+		allocCreateInfo.pool = getHostPool(_bufferInfo, allocCreateInfo);
+
+	if(vmaCreateBuffer(allocator, &_bufferInfo, &allocCreateInfo, &_buffer, &buffer.allocation, &buffer.allocationInfo) != VK_SUCCESS)
+		throw std::runtime_error("failed to create buffer!");
 
 	buffer.buffer = _buffer;
 
 	return buffer;
 }
 
-uint32_t Allocator::findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties)
+VmaPool Allocator::getHostPool(const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocCreateInfo)
 {
-	vk::PhysicalDeviceMemoryProperties memProperties = root.physicalDevice.getMemoryProperties();
+	uint32_t memoryType;
 
-	for(uint32_t i = 0; i < memProperties.memoryTypeCount; i++)
-	{
-		if((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties)
-			return i;
-	}
+	if(vmaFindMemoryTypeIndexForBufferInfo(allocator, &bufferInfo, &allocCreateInfo, &memoryType) != VK_SUCCESS)
+		throw std::runtime_error("failed to find suitable memory type!");
+
+	if(auto it = hostPools.find(memoryType); it != hostPools.end())
+		return it->second;
+
+	VmaPoolCreateInfo poolInfo = {};
+	poolInfo.memoryTypeIndex = memoryType;
+
+	VmaPool pool;
+
+	if(vmaCreatePool(allocator, &poolInfo, &pool) != VK_SUCCESS)
+		throw std::runtime_error("failed to create memory pool!");
+
+	return hostPools[memoryType] = pool;
+}
+
+Image Allocator::createImage(const vk::ImageCreateInfo& imageInfo, vk::MemoryPropertyFlags properties)
+{
+	Image image;
+
+	image.allocatorRef = allocator;
+
+	VkImageCreateInfo _imageInfo = imageInfo;
+	VkImage _image;
+
+	VmaAllocationCreateInfo allocCreateInfo = {};
+	allocCreateInfo.usage         = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+	allocCreateInfo.requiredFlags = (VkMemoryPropertyFlags)properties;
+
+	if(vmaCreateImage(allocator, &_imageInfo, &allocCreateInfo, &_image, &image.allocation, &image.allocationInfo) != VK_SUCCESS)
+		throw std::runtime_error("failed to create image!");
+
+	image.image = _image;
 
-	throw std::runtime_error("failed to find suitable memory type!");
+	return image;
 }
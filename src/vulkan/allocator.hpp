@@ -16,11 +16,35 @@
 
 #pragma once
 
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan_raii.hpp>
 
 class Renderer;
 
+/// How the CPU and the GPU use an allocation.
+enum class MemoryUsage
+{
+	/// Only the GPU touches it, filled with transfers.
+	GpuOnly,
+
+	/// Written once by the CPU, sequentially, then copied by the GPU.
+	Upload,
+
+	/// Rewritten by the CPU every frame and read by the GPU.
+	Dynamic,
+
+	/// Device local, mapped only when that memory is host visible. Otherwise
+	/// pMappedData is null and it has to be written with transfers.
+	Staged,
+
+	/// Written by the GPU and read by the CPU.
+	Readback
+};
+
 struct Buffer
 {
 	vk::Buffer        buffer         = {};
@@ -39,7 +63,29 @@ struct Buffer
 	~Buffer();
 
 	operator vk::Buffer&();
-	vk::Result flush();
+	vk::Result flush(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+	vk::Result invalidate(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+	void clear();
+};
+
+struct Image
+{
+	vk::Image         image          = {};
+	VmaAllocation     allocation     = {};
+	VmaAllocationInfo allocationInfo = {};
+	VmaAllocator      allocatorRef   = {};
+
+	Image()        = default;
+
+	Image(Image&)  = delete;
+	Image(Image&& other) noexcept;
+
+	Image& operator=(Image &)  = delete;
+	Image& operator=(Image && other) noexcept;
+
+	~Image();
+
+	operator vk::Image&();
 	void clear();
 };
 
@@ -51,10 +97,22 @@ public:
 
 	void create();
 
-	uint32_t findMemoryType(uint32_t typeFilter, vk::MemoryPropertyFlags properties);
-	Buffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags properties);
+	/// Host visible usages are persistently mapped. Buffers used by more
+	/// than one of queueFamilies are concurrent, so they never need an
+	/// ownership transfer.
+	Buffer createBuffer(vk::DeviceSize size, vk::BufferUsageFlags usage, MemoryUsage memoryUsage, std::span<const uint32_t> queueFamilies = {});
+
+	/// Sub-allocated from VMA's blocks unless the driver prefers a dedicated
+	/// allocation for it.
+	Image createImage(const vk::ImageCreateInfo& imageInfo, vk::MemoryPropertyFlags properties);
 
 private:
 	VmaAllocator allocator;
 	Renderer&    root;
+
+	// Per memory type, for the buffers that are rewritten or read back every
+	// frame, so they don't fragment the blocks of the long lived ones.
+	std::unordered_map<uint32_t, VmaPool> hostPools;
+
+	VmaPool getHostPool(const VkBufferCreateInfo& bufferInfo, const VmaAllocationCreateInfo& allocCreateInfo);
 };
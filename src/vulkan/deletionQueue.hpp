@@ -0,0 +1,53 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <utility>
+
+/// Resources kept alive until a timeline semaphore reaches the value they
+/// were pushed with.
+template<typename T>
+class DeletionQueue
+{
+private:
+	std::deque<std::pair<uint64_t, T>> queue;
+
+public:
+	/// Values must not decrease.
+	void push(uint64_t value, T&& resource)
+	{
+		queue.emplace_back(value, std::move(resource));
+	}
+
+	/// Calls destroy with every resource the GPU is done with.
+	template<typename F>
+	void flush(uint64_t completed, F&& destroy)
+	{
+		while(!queue.empty() && queue.front().first <= completed)
+		{
+			destroy(queue.front().second);
+			queue.pop_front();
+		}
+	}
+
+	void flush(uint64_t completed)
+	{
+		flush(completed, [](T&){});
+	}
+};
@@ -65,7 +65,7 @@ void Depth::create()
 {
 	vk::Format depthFormat = getFormat();
 
-	auto [_image, _imageMemory] = root.createImage(
+	image = root.createImage(
 		root.pipeline.swapChainExtent.width,
 		root.pipeline.swapChainExtent.height,
 		depthFormat,
@@ -74,18 +74,13 @@ void Depth::create()
 		vk::MemoryPropertyFlagBits::eDeviceLocal
 	);
 
-	image       = std::move(_image);
-	imageMemory = std::move(_imageMemory);
-	imageView   = root.createImageView(*image, depthFormat, vk::ImageAspectFlagBits::eDepth);
-
-	//root.transitionImageLayout(*image, depthFormat, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+	imageView = root.createImageView(image, depthFormat, vk::ImageAspectFlagBits::eDepth);
 }
 
 void Depth::clear()
 {
-	image.clear();
-	imageMemory.clear();
 	imageView.clear();
+	image.clear();
 }
 
 vk::Format Depth::getFormat()
@@ -105,12 +100,7 @@ vk::Format Depth::getFormat()
 
 vk::Image Depth::getImage()
 {
-	return *image;
-}
-
-vk::DeviceMemory Depth::getImageMemory()
-{
-	return *imageMemory;
+	return image;
 }
 
 vk::ImageView Depth::getImageView()
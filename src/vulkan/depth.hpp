@@ -20,6 +20,8 @@
 
 #include <vulkan/vulkan_raii.hpp>
 
+#include "allocator.hpp"
+
 class Renderer;
 
 class Depth
@@ -27,9 +29,8 @@ class Depth
 private:
 	Renderer& root;
 
-	vk::raii::Image        image       = nullptr;
-	vk::raii::DeviceMemory imageMemory = nullptr;
-	vk::raii::ImageView    imageView   = nullptr;
+	Image               image;
+	vk::raii::ImageView imageView = nullptr;
 
 	vk::Format findSupportedFormat(const std::span<const vk::Format> candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags features);
 
@@ -41,8 +42,7 @@ public:
 	void create();
 	void clear();
 
-	vk::Format       getFormat();
-	vk::Image        getImage();
-	vk::DeviceMemory getImageMemory();
-	vk::ImageView    getImageView();
+	vk::Format    getFormat();
+	vk::Image     getImage();
+	vk::ImageView getImageView();
 };
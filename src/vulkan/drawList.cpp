@@ -0,0 +1,143 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+
+#include "drawList.hpp"
+
+namespace DrawKey
+{
+
+static constexpr uint64_t mask(uint32_t bits)
+{
+	return (uint64_t(1) << bits) - 1;
+}
+
+uint64_t pack(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth)
+{
+	assert(pipeline <= mask(PIPELINE_BITS));
+	assert(material <= mask(MATERIAL_BITS));
+	assert(mesh <= mask(MESH_BITS));
+
+	uint64_t depthBucket = std::lround(std::clamp(depth, 0.f, 1.f) * mask(DEPTH_BITS));
+
+	return
+		uint64_t(pipeline) << PIPELINE_SHIFT |
+		uint64_t(material) << MATERIAL_SHIFT |
+		uint64_t(mesh)     << MESH_SHIFT |
+		depthBucket        << DEPTH_SHIFT;
+}
+
+uint32_t pipeline(uint64_t key)
+{
+	return (key >> PIPELINE_SHIFT) & mask(PIPELINE_BITS);
+}
+
+uint32_t material(uint64_t key)
+{
+	return (key >> MATERIAL_SHIFT) & mask(MATERIAL_BITS);
+}
+
+uint32_t mesh(uint64_t key)
+{
+	return (key >> MESH_SHIFT) & mask(MESH_BITS);
+}
+
+uint64_t state(uint64_t key)
+{
+	return key >> MESH_SHIFT;
+}
+
+}
+
+void DrawList::clear()
+{
+	keys.clear();
+	objects.clear();
+}
+
+void DrawList::add(uint64_t key, uint32_t object)
+{
+	keys.push_back(key);
+	objects.push_back(object);
+}
+
+void DrawList::sort()
+{
+	constexpr size_t PASSES = sizeof(uint64_t);
+
+	size_t n = keys.size();
+
+	// Every histogram is counted in a single read of the keys.
+	std::array<std::array<uint32_t, 256>, PASSES> histograms = {};
+
+	for(uint64_t key: keys)
+	{
+		for(size_t pass = 0; pass < PASSES; pass++)
+			histograms[pass][(key >> (pass*8)) & 0xff]++;
+	}
+
+	keyScratch.resize(n);
+	objectScratch.resize(n);
+
+	for(size_t pass = 0; pass < PASSES; pass++)
+	{
+		auto& histogram = histograms[pass];
+
+		uint32_t shift = pass*8;
+
+		// This byte doesn't change the order.
+		if(histogram[(keys.empty() ? 0 : keys[0] >> shift) & 0xff] == n)
+			continue;
+
+		uint32_t offset = 0;
+		for(uint32_t& count: histogram)
+		{
+			uint32_t c = count;
+			count  = offset;
+			offset += c;
+		}
+
+		for(size_t i = 0; i < n; i++)
+		{
+			uint32_t dst = histogram[(keys[i] >> shift) & 0xff]++;
+
+			keyScratch[dst]    = keys[i];
+			objectScratch[dst] = objects[i];
+		}
+
+		keys.swap(keyScratch);
+		objects.swap(objectScratch);
+	}
+}
+
+size_t DrawList::size() const
+{
+	return keys.size();
+}
+
+std::span<const uint64_t> DrawList::getKeys() const
+{
+	return keys;
+}
+
+std::span<const uint32_t> DrawList::getObjects() const
+{
+	return objects;
+}
@@ -0,0 +1,75 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// Packs the render state of a draw so that sorting the keys groups draws
+/// by state. From the most significant bits: pipeline, material, mesh and
+/// depth bucket.
+///
+/// The renderer has a single graphics pipeline and a single material, so
+/// those fields are reserved and always 0. Sorting skips their passes.
+namespace DrawKey
+{
+	constexpr uint32_t PIPELINE_BITS = 8;
+	constexpr uint32_t MATERIAL_BITS = 16;
+	constexpr uint32_t MESH_BITS     = 24;
+	constexpr uint32_t DEPTH_BITS    = 16;
+
+	constexpr uint32_t DEPTH_SHIFT    = 0;
+	constexpr uint32_t MESH_SHIFT     = DEPTH_SHIFT + DEPTH_BITS;
+	constexpr uint32_t MATERIAL_SHIFT = MESH_SHIFT + MESH_BITS;
+	constexpr uint32_t PIPELINE_SHIFT = MATERIAL_SHIFT + MATERIAL_BITS;
+
+	/// depth is in [0, 1], 0 is the near plane.
+	uint64_t pack(uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+
+	uint32_t pipeline(uint64_t key);
+	uint32_t material(uint64_t key);
+	uint32_t mesh(uint64_t key);
+
+	/// Everything but the depth, draws with the same state can be instanced.
+	uint64_t state(uint64_t key);
+}
+
+/// Objects to draw with their keys, sorted every frame.
+class DrawList
+{
+private:
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> objects;
+
+	// Radix sort ping-pong buffers.
+	std::vector<uint64_t> keyScratch;
+	std::vector<uint32_t> objectScratch;
+
+public:
+	void clear();
+	void add(uint64_t key, uint32_t object);
+
+	/// Stable LSD radix sort by key, one byte per pass. Passes where every
+	/// key has the same byte are skipped.
+	void sort();
+
+	size_t size() const;
+
+	std::span<const uint64_t> getKeys() const;
+	std::span<const uint32_t> getObjects() const;
+};
@@ -14,6 +14,13 @@
 // You should have received a copy of the GNU General Public License
 // along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
 #include "frameData.hpp"
 #include "renderer.hpp"
 #include "shaderStorageBufferObject.hpp"
@@ -26,9 +33,13 @@ void FrameData::create()
 {
 	createSyncObjects();
 	createCommandBuffers();
+	createSecondaryCommandBuffers();
 	createDescriptorPool();
-	createUniformBuffers();
-	createStorageBuffers();
+	createTransientAllocators();
+
+	for(auto& frame: data)
+		createObjectBuffers(frame, MIN_OBJECTS);
+
 	createDescriptorSets();
 }
 
@@ -42,19 +53,148 @@ int FrameData::getCurrentFrame() const
 	return currentFrame;
 }
 
-vk::Semaphore FrameData::getImageAvailable(size_t imageIndex)
+void FrameData::destroyLater(Buffer&& buffer)
 {
-	return *data[imageIndex].imageAvailable;
+	if(buffer.buffer)
+		bufferDeletionQueue.push(submitted + 1, std::move(buffer));
+}
+
+void FrameData::destroyLater(GeometryRange&& range)
+{
+	if(!range.empty())
+		rangeDeletionQueue.push(submitted + 1, std::exchange(range, {}));
+}
+
+void FrameData::flushDeletionQueues()
+{
+	uint64_t completed = timeline.getCounterValue();
+
+	bufferDeletionQueue.flush(completed);
+
+	rangeDeletionQueue.flush(completed, [this](GeometryRange& range){
+		root.geometry.free(range);
+	});
+}
+
+uint64_t FrameData::signalFrame()
+{
+	return data[currentFrame].timelineValue = ++submitted;
+}
+
+uint64_t FrameData::getSubmitted() const
+{
+	return submitted;
+}
+
+void FrameData::wait(uint64_t value) const
+{
+	vk::SemaphoreWaitInfo waitInfo({}, *timeline, value);
+
+	vk::Result result = root.device.waitSemaphores(waitInfo, std::numeric_limits<uint64_t>::max());
+
+	if(result != vk::Result::eSuccess)
+		throw std::runtime_error("failed to wait for the frame!");
+}
+
+void FrameData::waitFrame() const
+{
+	wait(data[currentFrame].timelineValue);
+}
+
+vk::Semaphore FrameData::getTimeline() const
+{
+	return *timeline;
+}
+
+size_t FrameData::getSecondaryCount() const
+{
+	return secondaryCount;
+}
+
+void FrameData::resetSecondaryCommandPools()
+{
+	for(auto& pool: data[currentFrame].secondaryCommandPools)
+		pool.reset();
+}
+
+void FrameData::markObjectsDirty(std::span<const uint32_t> objects)
+{
+	for(auto& frame: data)
+	{
+		for(uint32_t object: objects)
+		{
+			if(object >= frame.isObjectDirty.size())
+				frame.isObjectDirty.resize(object + 1, false);
+
+			if(!frame.isObjectDirty[object])
+			{
+				frame.isObjectDirty[object] = true;
+				frame.dirtyObjects.push_back(object);
+			}
+		}
+	}
+}
+
+void FrameData::pushUniforms(const UniformBufferObject& ubo)
+{
+	auto& frame = data[currentFrame];
+
+	frame.uniformOffset = frame.transient.push(ubo, uniformAlignment).offset;
+}
+
+uint32_t FrameData::getUniformOffset() const
+{
+	return data[currentFrame].uniformOffset;
+}
+
+static_assert(FrameData::objectCapacity(0, 0)       == 1024);
+static_assert(FrameData::objectCapacity(1024, 5000) == 8192);
+static_assert(FrameData::objectCapacity(8192, 2049) == 8192);
+static_assert(FrameData::objectCapacity(8192, 2047) == 2048);
+static_assert(FrameData::objectCapacity(2048, 511)  == 1024);
+
+void FrameData::reserveObjects(uint32_t count)
+{
+	auto& frame = data[currentFrame];
+
+	uint32_t capacity = objectCapacity(frame.objectCapacity, count);
+
+	if(capacity == frame.objectCapacity)
+		return;
+
+	// The GPU is done with the previous use of this frame, see waitFrame().
+	createObjectBuffers(frame, capacity);
+	writeDescriptorSet(frame);
+
+	// Everything is written again, objects past count don't exist anymore.
+	clearDirtyObjects();
+
+	frame.isObjectDirty.assign(count, true);
+	frame.dirtyObjects.resize(count);
+
+	std::iota(frame.dirtyObjects.begin(), frame.dirtyObjects.end(), 0);
 }
 
-vk::Semaphore FrameData::getRenderFinished(size_t imageIndex)
+std::span<const uint32_t> FrameData::getDirtyObjects()
 {
-	return *data[imageIndex].renderFinished;
+	return data[currentFrame].dirtyObjects;
 }
 
-vk::Fence FrameData::getInFlight(size_t imageIndex)
+void FrameData::clearDirtyObjects()
 {
-	return *data[imageIndex].inFlight;
+	auto& frame = data[currentFrame];
+
+	for(uint32_t object: frame.dirtyObjects)
+	{
+		frame.isObjectDirty[object] = false;
+	}
+
+	frame.dirtyObjects.clear();
+}
+
+vk::Semaphore FrameData::getImageAvailable(size_t imageIndex)
+{
+	return *data[imageIndex].imageAvailable;
 }
 
 vk::CommandBuffer FrameData::getCommandBuffer(size_t imageIndex)
@@ -67,29 +207,29 @@ vk::DescriptorSet FrameData::getDescriptorSet(size_t imageIndex)
 	return data[imageIndex].descriptorSet;
 }
 
-Buffer& FrameData::getUniformBuffer(size_t imageIndex)
+Buffer& FrameData::getStorageBuffer(size_t imageIndex)
 {
-	return data[imageIndex].uniformBuffer;
+	return data[imageIndex].storageBuffer;
 }
 
-Buffer& FrameData::getStorageBuffer(size_t imageIndex)
+Buffer& FrameData::getObjectStaging(size_t imageIndex)
 {
-	return data[imageIndex].storageBuffer;
+	return data[imageIndex].objectStaging;
 }
 
-vk::Semaphore FrameData::getImageAvailable()
+Buffer& FrameData::getIndirectBuffer(size_t imageIndex)
 {
-	return getImageAvailable(getCurrentFrame());
+	return data[imageIndex].indirectBuffer;
 }
 
-vk::Semaphore FrameData::getRenderFinished()
+Buffer& FrameData::getInstanceBuffer(size_t imageIndex)
 {
-	return getRenderFinished(getCurrentFrame());
+	return data[imageIndex].instanceBuffer;
 }
 
-vk::Fence FrameData::getInFlight()
+vk::Semaphore FrameData::getImageAvailable()
 {
-	return getInFlight(getCurrentFrame());
+	return getImageAvailable(getCurrentFrame());
 }
 
 vk::CommandBuffer FrameData::getCommandBuffer()
@@ -97,6 +237,16 @@ vk::CommandBuffer FrameData::getCommandBuffer()
 	return getCommandBuffer(getCurrentFrame());
 }
 
+vk::CommandBuffer FrameData::getSecondaryCommandBuffer(size_t chunk)
+{
+	return data[currentFrame].secondaryCommandBuffers[chunk];
+}
+
+std::span<const vk::CommandBuffer> FrameData::getSecondaryCommandBuffers()
+{
+	return data[currentFrame].secondaryCommandBuffers;
+}
+
 vk::DescriptorPool FrameData::getDescriptorPool()
 {
 	return *descriptorPool;
@@ -107,9 +257,9 @@ vk::DescriptorSet FrameData::getDescriptorSet()
 	return getDescriptorSet(getCurrentFrame());
 }
 
-Buffer& FrameData::getUniformBuffer()
+LinearAllocator& FrameData::getTransient()
 {
-	return getUniformBuffer(getCurrentFrame());
+	return data[currentFrame].transient;
 }
 
 Buffer& FrameData::getStorageBuffer()
@@ -117,18 +267,33 @@ Buffer& FrameData::getStorageBuffer()
 	return getStorageBuffer(getCurrentFrame());
 }
 
+Buffer& FrameData::getObjectStaging()
+{
+	return getObjectStaging(getCurrentFrame());
+}
+
+Buffer& FrameData::getIndirectBuffer()
+{
+	return getIndirectBuffer(getCurrentFrame());
+}
+
+Buffer& FrameData::getInstanceBuffer()
+{
+	return getInstanceBuffer(getCurrentFrame());
+}
+
 void FrameData::createSyncObjects()
 {
 	vk::SemaphoreCreateInfo semaphoreInfo;
 
-	// Start signaled to avoid a deadlock in the first frame.
-	vk::FenceCreateInfo fenceInfo(vk::FenceCreateFlagBits::eSignaled);
+	// Frames that were never submitted wait for 0.
+	vk::SemaphoreTypeCreateInfo timelineInfo(vk::SemaphoreType::eTimeline, 0);
+
+	timeline = root.device.createSemaphore(vk::SemaphoreCreateInfo({}, &timelineInfo));
 
 	for(size_t i = 0; i < data.size(); i++)
 	{
 		data[i].imageAvailable = root.device.createSemaphore(semaphoreInfo);
-		data[i].renderFinished = root.device.createSemaphore(semaphoreInfo);
-		data[i].inFlight       = root.device.createFence(fenceInfo);
 	}
 }
 void FrameData::createCommandBuffers()
@@ -147,17 +312,41 @@ void FrameData::createCommandBuffers()
 	}
 }
 
+void FrameData::createSecondaryCommandBuffers()
+{
+	QueueFamilyIndices queueFamilyIndices = root.findQueueFamilies(*root.physicalDevice);
+
+	secondaryCount = std::max(1u, std::thread::hardware_concurrency());
+
+	vk::CommandPoolCreateInfo poolInfo(
+		vk::CommandPoolCreateFlagBits::eTransient,
+		queueFamilyIndices.graphicsFamily.value()
+	);
+
+	for(auto& frame: data)
+	{
+		for(size_t i = 0; i < secondaryCount; i++)
+		{
+			auto& pool = frame.secondaryCommandPools.emplace_back(root.device.createCommandPool(poolInfo));
+
+			vk::CommandBufferAllocateInfo allocInfo(*pool, vk::CommandBufferLevel::eSecondary, 1);
+
+			frame.secondaryCommandBuffers.push_back((*root.device).allocateCommandBuffers(allocInfo).front());
+		}
+	}
+}
+
 void FrameData::createDescriptorPool()
 {
 	vk::DescriptorPoolSize poolSizes[] =
 	{
 		vk::DescriptorPoolSize(
-			vk::DescriptorType::eUniformBuffer,
+			vk::DescriptorType::eUniformBufferDynamic,
 			MAX_FRAMES_IN_FLIGHT
 		),
 		vk::DescriptorPoolSize(
 			vk::DescriptorType::eStorageBuffer,
-			MAX_FRAMES_IN_FLIGHT
+			MAX_FRAMES_IN_FLIGHT*3
 		),
 		vk::DescriptorPoolSize(
 			vk::DescriptorType::eCombinedImageSampler,
@@ -183,85 +372,143 @@ void FrameData::createDescriptorSets()
 		data[i].descriptorSet = descriptorSets[i];
 	}
 
-	for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	for(auto& frame: data)
+		writeDescriptorSet(frame);
+}
+
+void FrameData::writeDescriptorSet(Data& frame)
+{
+	vk::DescriptorBufferInfo bufferInfo(
+		frame.transient.getBuffer(),
+		0,
+		sizeof(UniformBufferObject)
+	);
+
+	vk::DescriptorBufferInfo storageBufferInfo(
+		frame.storageBuffer,
+		0,
+		sizeof(ShaderStorageBufferObject)*frame.objectCapacity
+	);
+
+	vk::DescriptorBufferInfo drawCommandBufferInfo(
+		frame.indirectBuffer,
+		0,
+		sizeof(vk::DrawIndexedIndirectCommand)*frame.objectCapacity
+	);
+
+	vk::DescriptorBufferInfo instanceBufferInfo(
+		frame.instanceBuffer,
+		0,
+		sizeof(uint32_t)*frame.objectCapacity
+	);
+
+	vk::DescriptorImageInfo imageInfo(
+		*root.textureSampler,
+		*root.textureImageView,
+		vk::ImageLayout::eShaderReadOnlyOptimal
+	);
+
+	vk::WriteDescriptorSet descriptorWrites[] =
 	{
-		vk::DescriptorBufferInfo bufferInfo(
-			data[i].uniformBuffer,
+		vk::WriteDescriptorSet(
+			frame.descriptorSet,
 			0,
-			sizeof(UniformBufferObject)
-		);
-
-		vk::DescriptorBufferInfo storageBufferInfo(
-			data[i].storageBuffer,
 			0,
-			sizeof(ShaderStorageBufferObject)*MAX_OBJECTS
-		);
-
-		vk::DescriptorImageInfo imageInfo(
-			*root.textureSampler,
-			*root.textureImageView,
-			vk::ImageLayout::eShaderReadOnlyOptimal
-		);
+			vk::DescriptorType::eUniformBufferDynamic,
+			nullptr,
+			bufferInfo,
+			nullptr
+		),
+		vk::WriteDescriptorSet(
+			frame.descriptorSet,
+			1,
+			0,
+			vk::DescriptorType::eStorageBuffer,
+			nullptr,
+			storageBufferInfo,
+			nullptr
+		),
+		vk::WriteDescriptorSet(
+			frame.descriptorSet,
+			2,
+			0,
+			vk::DescriptorType::eCombinedImageSampler,
+			imageInfo,
+			nullptr,
+			nullptr
+		),
+		vk::WriteDescriptorSet(
+			frame.descriptorSet,
+			3,
+			0,
+			vk::DescriptorType::eStorageBuffer,
+			nullptr,
+			drawCommandBufferInfo,
+			nullptr
+		),
+		vk::WriteDescriptorSet(
+			frame.descriptorSet,
+			4,
+			0,
+			vk::DescriptorType::eStorageBuffer,
+			nullptr,
+			instanceBufferInfo,
+			nullptr
+		)
+	};
 
-		vk::WriteDescriptorSet descriptorWrites[] =
-		{
-			vk::WriteDescriptorSet(
-				data[i].descriptorSet,
-				0,
-				0,
-				vk::DescriptorType::eUniformBuffer,
-				nullptr,
-				bufferInfo,
-				nullptr
-			),
-			vk::WriteDescriptorSet(
-				data[i].descriptorSet,
-				1,
-				0,
-				vk::DescriptorType::eStorageBuffer,
-				nullptr,
-				storageBufferInfo,
-				nullptr
-			),
-			vk::WriteDescriptorSet(
-				data[i].descriptorSet,
-				2,
-				0,
-				vk::DescriptorType::eCombinedImageSampler,
-				imageInfo,
-				nullptr,
-				nullptr
-			)
-		};
-
-		root.device.updateDescriptorSets(descriptorWrites, nullptr);
-	}
+	root.device.updateDescriptorSets(descriptorWrites, nullptr);
 }
 
-void FrameData::createUniformBuffers()
+void FrameData::createTransientAllocators()
 {
-	vk::DeviceSize bufferSize = sizeof(UniformBufferObject);
+	using enum vk::BufferUsageFlagBits;
 
-	for(size_t i = 0; i < data.size(); i++)
+	uniformAlignment = root.physicalDevice.getProperties().limits.minUniformBufferOffsetAlignment;
+
+	for(auto& frame: data)
 	{
-		data[i].uniformBuffer = root.allocator.createBuffer(
-			bufferSize,
-			vk::BufferUsageFlagBits::eUniformBuffer,
-			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+		frame.transient.create(
+			root.allocator,
+			TRANSIENT_SIZE,
+			eUniformBuffer | eStorageBuffer | eIndirectBuffer | eVertexBuffer | eIndexBuffer
 		);
 	}
 }
 
-void FrameData::createStorageBuffers()
+void FrameData::createObjectBuffers(Data& frame, uint32_t capacity)
 {
-	vk::DeviceSize bufferSize = sizeof(ShaderStorageBufferObject)*MAX_OBJECTS;
+	using enum vk::BufferUsageFlagBits;
 
-	for(size_t i = 0; i < data.size(); i++)
-	{
-		data[i].storageBuffer = root.allocator.createBuffer(
-			bufferSize,
-			vk::BufferUsageFlagBits::eStorageBuffer,
-			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent
+	frame.objectCapacity = capacity;
+
+	// Written through ReBAR, or through staging copies without it.
+	frame.storageBuffer = root.allocator.createBuffer(
+		sizeof(ShaderStorageBufferObject)*capacity,
+		eStorageBuffer | eTransferDst,
+		MemoryUsage::Staged
+	);
+
+	// The copies are recorded in the frame's own command buffer, the
+	// transfer queue would need to own storageBuffer to write it.
+	if(frame.storageBuffer.allocationInfo.pMappedData)
+		frame.objectStaging.clear();
+	else
+		frame.objectStaging = root.allocator.createBuffer(
+			sizeof(ShaderStorageBufferObject)*capacity,
+			eTransferSrc,
+			MemoryUsage::Upload
 		);
-	}
+
+	frame.indirectBuffer = root.allocator.createBuffer(
+		sizeof(vk::DrawIndexedIndirectCommand)*capacity,
+		eIndirectBuffer | eStorageBuffer,
+		MemoryUsage::Dynamic
+	);
+
+	frame.instanceBuffer = root.allocator.createBuffer(
+		sizeof(uint32_t)*capacity,
+		eStorageBuffer,
+		MemoryUsage::Dynamic
+	);
 }
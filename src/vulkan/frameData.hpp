@@ -16,11 +16,20 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
 
 #include <vulkan/vulkan_raii.hpp>
 
 #include "allocator.hpp"
+#include "deletionQueue.hpp"
+#include "geometryBuffer.hpp"
+#include "linearAllocator.hpp"
 #include "uniformBufferObject.hpp"
 
 class Renderer;
@@ -29,22 +38,51 @@ class FrameData
 {
 private:
 	// TODO: Make this a SOA
-	// TODO: Dynamic object buffer
 	static const int MAX_FRAMES_IN_FLIGHT = 2;
-	static const int MAX_OBJECTS          = 100000;
+
+	static const vk::DeviceSize TRANSIENT_SIZE = 4 << 20;
+
+	// The object buffers never get smaller than this.
+	static constexpr uint32_t MIN_OBJECTS = 1024;
 
 	struct Data
 	{
 		mutable vk::raii::Semaphore imageAvailable = nullptr;
-		mutable vk::raii::Semaphore renderFinished = nullptr;
-		mutable vk::raii::Fence     inFlight       = nullptr;
+
+		// Reached by the timeline when the GPU is done with this frame.
+		uint64_t timelineValue = 0;
 
 		vk::raii::CommandBuffer commandBuffer = nullptr;
 
-		Buffer uniformBuffer;
-		Buffer storageBuffer;
+		// One pool per recording task, pools can't be used by two threads
+		// at once. The buffers are freed with their pools.
+		std::vector<vk::raii::CommandPool> secondaryCommandPools;
+		std::vector<vk::CommandBuffer>     secondaryCommandBuffers;
+
+		// Data written every frame, reset when the frame is done. Bound with
+		// dynamic offsets, so it needs no buffer or descriptor of its own.
+		LinearAllocator transient;
+		uint32_t        uniformOffset = 0;
+
+		// Objects that fit in storageBuffer, indirectBuffer and instanceBuffer.
+		uint32_t objectCapacity = 0;
+		Buffer   storageBuffer;
+
+		// Same layout as storageBuffer, only when storageBuffer isn't mapped.
+		Buffer objectStaging;
+
+		// One VkDrawIndexedIndirectCommand per batch, the culling pass
+		// writes their instance counts.
+		Buffer indirectBuffer;
+
+		// Object of each instance, gl_InstanceIndex indexes it.
+		Buffer instanceBuffer;
 
 		vk::DescriptorSet descriptorSet;
+
+		// Objects that changed since storageBuffer was last written.
+		std::vector<uint32_t> dirtyObjects;
+		std::vector<uint8_t>  isObjectDirty;
 	};
 
 	Renderer& root;
@@ -55,12 +93,25 @@ private:
 
 	int currentFrame = 0;
 
+	// Every frame submission signals the next value.
+	vk::raii::Semaphore timeline  = nullptr;
+	uint64_t            submitted = 0;
+
+	DeletionQueue<Buffer>        bufferDeletionQueue;
+	DeletionQueue<GeometryRange> rangeDeletionQueue;
+
+	size_t secondaryCount = 1;
+
+	vk::DeviceSize uniformAlignment = 1;
+
 	void createSyncObjects();
 	void createCommandBuffers();
+	void createSecondaryCommandBuffers();
 	void createDescriptorPool();
 	void createDescriptorSets();
-	void createUniformBuffers();
-	void createStorageBuffers();
+	void createTransientAllocators();
+	void createObjectBuffers(Data& frame, uint32_t capacity);
+	void writeDescriptorSet(Data& frame);
 
 public:
 	FrameData(Renderer& root);
@@ -70,22 +121,86 @@ public:
 	int incrementFrame();
 	int getCurrentFrame() const;
 
+	/// Keeps resources alive until the GPU is done with every frame
+	/// submitted so far and with the current one.
+	void destroyLater(Buffer&& buffer);
+	void destroyLater(GeometryRange&& range);
+
+	/// Destroys what the GPU is done with.
+	void flushDeletionQueues();
+
+	/// Returns the value the current frame signals when it's submitted.
+	uint64_t signalFrame();
+
+	/// Last signaled value of every submitted frame.
+	uint64_t getSubmitted() const;
+
+	/// Blocks until the timeline reaches value.
+	void wait(uint64_t value) const;
+
+	/// Blocks until the GPU is done with the previous use of the current
+	/// frame.
+	void waitFrame() const;
+
+	vk::Semaphore getTimeline() const;
+
+	/// Secondary command buffers of each frame, one per worker thread.
+	size_t getSecondaryCount() const;
+
+	/// The current frame must be done, see waitFrame().
+	void resetSecondaryCommandPools();
+
+	/// Every frame in flight has to upload these objects again.
+	void markObjectsDirty(std::span<const uint32_t> objects);
+
+	/// Writes the UniformBufferObject of the current frame to its transient
+	/// buffer.
+	void pushUniforms(const UniformBufferObject& ubo);
+
+	/// Dynamic offset of the uniform buffer in the current descriptor set.
+	uint32_t getUniformOffset() const;
+
+	/// Resizes the object buffers of the current frame when count doesn't
+	/// fit or uses less than a quarter of them. Their contents are lost, so
+	/// every object becomes dirty for this frame.
+	void reserveObjects(uint32_t count);
+
+	/// Capacity of the object buffers that hold count objects, current if
+	/// they don't need to be reallocated.
+	static constexpr uint32_t objectCapacity(uint32_t capacity, uint32_t count)
+	{
+		// Shrinking waits until a quarter is used, so a scene around a power
+		// of two doesn't reallocate every frame.
+		if(count <= capacity && count > capacity / 4)
+			return capacity;
+
+		return std::max(MIN_OBJECTS, std::bit_ceil(count));
+	}
+
+	/// Objects the current frame has to upload.
+	std::span<const uint32_t> getDirtyObjects();
+	void                      clearDirtyObjects();
+
 	vk::Semaphore      getImageAvailable(size_t imageIndex);
-	vk::Semaphore      getRenderFinished(size_t imageIndex);
-	vk::Fence          getInFlight(size_t imageIndex);
 	vk::CommandBuffer  getCommandBuffer(size_t imageIndex);
 	vk::DescriptorSet  getDescriptorSet(size_t imageIndex);
-	Buffer&            getUniformBuffer(size_t imageIndex);
 	Buffer&            getStorageBuffer(size_t imageIndex);
+	Buffer&            getObjectStaging(size_t imageIndex);
+	Buffer&            getIndirectBuffer(size_t imageIndex);
+	Buffer&            getInstanceBuffer(size_t imageIndex);
 
 	vk::Semaphore      getImageAvailable();
-	vk::Semaphore      getRenderFinished();
-	vk::Fence          getInFlight();
 	vk::CommandBuffer  getCommandBuffer();
+	vk::CommandBuffer  getSecondaryCommandBuffer(size_t chunk);
+
+	std::span<const vk::CommandBuffer> getSecondaryCommandBuffers();
 	vk::DescriptorPool getDescriptorPool();
 	vk::DescriptorSet  getDescriptorSet();
-	Buffer&            getUniformBuffer();
+	LinearAllocator&   getTransient();
 	Buffer&            getStorageBuffer();
+	Buffer&            getObjectStaging();
+	Buffer&            getIndirectBuffer();
+	Buffer&            getInstanceBuffer();
 
 	friend class Renderer;
 };
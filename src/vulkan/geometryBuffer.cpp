@@ -0,0 +1,189 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "geometryBuffer.hpp"
+#include "renderer.hpp"
+
+bool GeometryRange::empty() const
+{
+	return allocation == VK_NULL_HANDLE;
+}
+
+GeometryBuffer::GeometryBuffer(Renderer& root):
+	root(root)
+{
+	using enum vk::BufferUsageFlagBits;
+
+	vertices.usage       = eTransferSrc | eTransferDst | eVertexBuffer;
+	vertices.elementSize = sizeof(Vertex);
+
+	indices.usage       = eTransferSrc | eTransferDst | eIndexBuffer;
+	indices.elementSize = sizeof(uint32_t);
+}
+
+GeometryBuffer::~GeometryBuffer()
+{
+	// Meshes don't outlive the renderer.
+	for(Arena* arena: {&vertices, &indices})
+	{
+		for(auto [block, first]: arena->blocks)
+		{
+			vmaClearVirtualBlock(block);
+			vmaDestroyVirtualBlock(block);
+		}
+	}
+}
+
+void GeometryBuffer::create()
+{
+	grow(vertices, INITIAL_VERTICES);
+	grow(indices, INITIAL_INDICES);
+}
+
+GeometryRange GeometryBuffer::allocate(Arena& arena, uint32_t count)
+{
+	GeometryRange range;
+
+	if(count == 0)
+		return range;
+
+	for(auto [block, first]: arena.blocks)
+	{
+		if(allocate(block, first, count, range))
+			return range;
+	}
+
+	grow(arena, count);
+
+	auto [block, first] = arena.blocks.back();
+
+	if(!allocate(block, first, count, range))
+		throw std::runtime_error("failed to allocate geometry!");
+
+	return range;
+}
+
+bool GeometryBuffer::allocate(VmaVirtualBlock block, uint32_t first, uint32_t count, GeometryRange& range)
+{
+	// Sizes in elements, so offsets are vertexOffset and firstIndex.
+	VmaVirtualAllocationCreateInfo allocInfo{.size = count};
+	VkDeviceSize offset;
+
+	if(vmaVirtualAllocate(block, &allocInfo, &range.allocation, &offset) != VK_SUCCESS)
+		return false;
+
+	range.block  = block;
+	range.offset = first + offset;
+	range.count  = count;
+
+	return true;
+}
+
+void GeometryBuffer::grow(Arena& arena, uint32_t count)
+{
+	uint32_t capacity = std::max(arena.capacity * 2, arena.capacity + count);
+
+	VmaVirtualBlockCreateInfo blockInfo{.size = capacity - arena.capacity};
+	VmaVirtualBlock           block;
+
+	if(vmaCreateVirtualBlock(&blockInfo, &block) != VK_SUCCESS)
+		throw std::runtime_error("failed to create geometry buffer!");
+
+	// Shared with the upload queue, it writes ranges the graphics queue
+	// has already read or copied.
+	Buffer buffer = root.allocator.createBuffer(arena.elementSize * capacity, arena.usage, MemoryUsage::GpuOnly, root.uploads.getQueueFamilies());
+
+	if(arena.capacity > 0)
+	{
+		// Pending uploads to the old buffer finish first, the images they
+		// wrote are acquired before the copy.
+		root.uploads.wait(root.uploads.submit());
+
+		auto singleCommand = root.makeSingleCommand();
+
+		vk::CommandBuffer commandBuffer = singleCommand.getBuffer();
+
+		root.uploads.recordAcquires(commandBuffer);
+
+		vk::BufferCopy copyRegion(0, 0, arena.elementSize * arena.capacity);
+		commandBuffer.copyBuffer(arena.buffer.buffer, buffer.buffer, copyRegion);
+
+		vk::MemoryBarrier copyBarrier(
+			vk::AccessFlagBits::eTransferWrite,
+			vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead
+		);
+
+		commandBuffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer,
+			vk::PipelineStageFlagBits::eVertexInput,
+			{},
+			copyBarrier,
+			nullptr,
+			nullptr
+		);
+	}
+
+	root.frameData.destroyLater(std::move(arena.buffer));
+
+	arena.buffer = std::move(buffer);
+	arena.blocks.emplace_back(block, arena.capacity);
+	arena.capacity = capacity;
+}
+
+void GeometryBuffer::upload(Buffer& dst, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size)
+{
+	root.uploads.upload(dst, dstOffset, data, size);
+}
+
+GeometryRange GeometryBuffer::uploadVertices(std::span<const Vertex> vertices)
+{
+	GeometryRange range = allocate(this->vertices, vertices.size());
+
+	if(!range.empty())
+		upload(this->vertices.buffer, sizeof(Vertex) * range.offset, vertices.data(), vertices.size_bytes());
+
+	return range;
+}
+
+GeometryRange GeometryBuffer::uploadIndices(std::span<const uint32_t> indices)
+{
+	GeometryRange range = allocate(this->indices, indices.size());
+
+	if(!range.empty())
+		upload(this->indices.buffer, sizeof(uint32_t) * range.offset, indices.data(), indices.size_bytes());
+
+	return range;
+}
+
+void GeometryBuffer::free(GeometryRange& range)
+{
+	if(!range.empty())
+		vmaVirtualFree(range.block, range.allocation);
+
+	range = {};
+}
+
+void GeometryBuffer::bind(vk::CommandBuffer commandBuffer) const
+{
+	vk::Buffer     vertexBuffers[] = {vertices.buffer.buffer};
+	vk::DeviceSize offsets[]       = {0};
+
+	commandBuffer.bindVertexBuffers(0, vertexBuffers, offsets);
+	commandBuffer.bindIndexBuffer(indices.buffer.buffer, 0, vk::IndexType::eUint32);
+}
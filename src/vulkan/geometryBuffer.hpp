@@ -0,0 +1,93 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan_raii.hpp>
+
+#include "../vertex.hpp"
+#include "allocator.hpp"
+
+class Renderer;
+
+/// Elements of a GeometryBuffer, offset and count are in vertices or indices.
+struct GeometryRange
+{
+	VmaVirtualBlock      block      = {};
+	VmaVirtualAllocation allocation = {};
+
+	uint32_t offset = 0;
+	uint32_t count  = 0;
+
+	bool empty() const;
+};
+
+/// One vertex buffer and one index buffer shared by every mesh, so a whole
+/// scene is drawn with a single bind.
+class GeometryBuffer
+{
+private:
+	static const uint32_t INITIAL_VERTICES = 1 << 16;
+	static const uint32_t INITIAL_INDICES  = 1 << 18;
+
+	/// A buffer that at least doubles when it's full. Virtual blocks can't
+	/// grow, so each growth adds one for the new elements.
+	struct Arena
+	{
+		vk::BufferUsageFlags usage;
+		vk::DeviceSize       elementSize;
+
+		Buffer   buffer;
+		uint32_t capacity = 0;
+
+		// Each with the index of its first element.
+		std::vector<std::pair<VmaVirtualBlock, uint32_t>> blocks;
+	};
+
+	Renderer& root;
+
+	Arena vertices;
+	Arena indices;
+
+	GeometryRange allocate(Arena& arena, uint32_t count);
+	static bool allocate(VmaVirtualBlock block, uint32_t first, uint32_t count, GeometryRange& range);
+
+	/// Copies the old buffer on the graphics queue, in-flight frames keep
+	/// using it until FrameData destroys it.
+	void grow(Arena& arena, uint32_t count);
+
+	void upload(Buffer& dst, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size);
+
+public:
+	GeometryBuffer(Renderer& root);
+	~GeometryBuffer();
+
+	void create();
+
+	GeometryRange uploadVertices(std::span<const Vertex> vertices);
+	GeometryRange uploadIndices(std::span<const uint32_t> indices);
+
+	/// The range must not be used by a frame in flight, see FrameData::destroyLater().
+	void free(GeometryRange& range);
+
+	void bind(vk::CommandBuffer commandBuffer) const;
+};
@@ -0,0 +1,53 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <stdexcept>
+
+#include "linearAllocator.hpp"
+
+void LinearAllocator::create(Allocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage)
+{
+	buffer     = allocator.createBuffer(size, usage, MemoryUsage::Dynamic);
+	this->size = size;
+	head       = 0;
+}
+
+LinearAllocator::Allocation LinearAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+	vk::DeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+
+	if(offset + size > this->size)
+		throw std::runtime_error("linear allocator is full!");
+
+	head = offset + size;
+
+	return {buffer.buffer, offset, (char*)buffer.allocationInfo.pMappedData + offset};
+}
+
+void LinearAllocator::reset()
+{
+	head = 0;
+}
+
+vk::Result LinearAllocator::flush()
+{
+	return buffer.flush(0, head);
+}
+
+Buffer& LinearAllocator::getBuffer()
+{
+	return buffer;
+}
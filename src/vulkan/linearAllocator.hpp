@@ -0,0 +1,66 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include <vulkan/vulkan.hpp>
+
+#include "allocator.hpp"
+
+/// Bump allocator over one mapped buffer, for data that lives a single
+/// frame. Everything is freed at once with reset().
+class LinearAllocator
+{
+public:
+	struct Allocation
+	{
+		vk::Buffer     buffer;
+		vk::DeviceSize offset;
+		void*          data;
+	};
+
+private:
+	Buffer         buffer;
+	vk::DeviceSize size = 0;
+	vk::DeviceSize head = 0;
+
+public:
+	void create(Allocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage);
+
+	/// Alignment must be a power of two.
+	Allocation allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+
+	template<typename T>
+	Allocation push(const T& value, vk::DeviceSize alignment)
+	{
+		Allocation allocation = allocate(sizeof(T), std::max<vk::DeviceSize>(alignment, alignof(T)));
+
+		*(T*)allocation.data = value;
+
+		return allocation;
+	}
+
+	/// The GPU must be done with everything allocated since the last reset.
+	void reset();
+
+	/// Flushes what was allocated since the last reset.
+	vk::Result flush();
+
+	Buffer& getBuffer();
+};
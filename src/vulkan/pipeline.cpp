@@ -14,12 +14,17 @@
 // You should have received a copy of the GNU General Public License
 // along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <iostream>
+#include <optional>
 
 #include "../config.hpp"
 #include "../engine.hpp"
 #include "../scene.hpp"
 #include "../vertex.hpp"
+#include "drawList.hpp"
 #include "pipeline.hpp"
 #include "renderer.hpp"
 #include "uniformBufferObject.hpp"
@@ -32,16 +37,24 @@ Pipeline::Pipeline(Renderer& parent):
 
 void Pipeline::create()
 {
-	createSwapChain(*parent.physicalDevice);
+	if(parent.isHeadless())
+		createOffscreenImages();
+	else
+		createSwapChain(*parent.physicalDevice);
+
 	createImageViews();
 	depth.create();
 	createRenderPass();
-	createGraphicsPipeline();
+	createPipelines();
 	createFramebuffers();
 }
 
 void Pipeline::recreate()
 {
+	// Offscreen images never change size.
+	if(parent.isHeadless())
+		return;
+
 	int width = 0, height = 0;
 	glfwGetFramebufferSize(parent.engine.getWindow(), &width, &height);
 
@@ -51,18 +64,42 @@ void Pipeline::recreate()
 		glfwWaitEvents();
 	}
 
-	parent.device.waitIdle();
+	// Only the frames use the swap chain, uploads keep running. The
+	// semaphores of pending presentations are destroyed too.
+	parent.frameData.wait(parent.frameData.getSubmitted());
+	parent.presentQueue.waitIdle();
 
+	// Only what depends on the extent or the present mode is rebuilt,
+	// viewport and scissor are dynamic.
 	depth.clear();
 	swapChainFramebuffers.clear();
-
-	graphicsPipeline.clear();
-	pipelineLayout.clear();
-	renderPass.clear();
 	swapChainImageViews.clear();
-	swapChain.clear();
+	swapChainImages.clear();
+	renderFinished.clear();
+
+	vk::Format             oldFormat    = swapChainImageFormat;
+	vk::raii::SwapchainKHR oldSwapChain = std::move(swapChain);
+
+	// The driver can reuse the resources of the old swap chain.
+	createSwapChain(*parent.physicalDevice, *oldSwapChain);
+	oldSwapChain.clear();
+
+	createImageViews();
+	depth.create();
+
+	// Pipelines are only compatible with render passes of the same formats.
+	if(swapChainImageFormat != oldFormat)
+	{
+		graphicsPipeline.clear();
+		cullPipeline.clear();
+		pipelineLayout.clear();
+		renderPass.clear();
 
-	create();
+		createRenderPass();
+		createPipelines();
+	}
+
+	createFramebuffers();
 };
 
 void Pipeline::createImageViews()
@@ -74,7 +111,7 @@ void Pipeline::createImageViews()
 	}
 }
 
-void Pipeline::createSwapChain(vk::PhysicalDevice physicalDevice)
+void Pipeline::createSwapChain(vk::PhysicalDevice physicalDevice, vk::SwapchainKHR oldSwapChain)
 {
 	SwapChainSupportDetails swapChainSupport = parent.querySwapChainSupport(physicalDevice);
 
@@ -102,7 +139,7 @@ void Pipeline::createSwapChain(vk::PhysicalDevice physicalDevice)
 		vk::CompositeAlphaFlagBitsKHR::eOpaque,
 		presentMode,
 		true,
-		nullptr
+		oldSwapChain
 	);
 
 	QueueFamilyIndices indices = parent.findQueueFamilies(*parent.physicalDevice);
@@ -126,6 +163,35 @@ void Pipeline::createSwapChain(vk::PhysicalDevice physicalDevice)
 	swapChainImages      = swapChain.getImages();
 	swapChainImageFormat = surfaceFormat.format;
 	swapChainExtent      = extent;
+
+	vk::SemaphoreCreateInfo semaphoreInfo;
+
+	renderFinished.reserve(swapChainImages.size());
+	for(size_t i = 0; i < swapChainImages.size(); i++)
+	{
+		renderFinished.emplace_back(parent.device.createSemaphore(semaphoreInfo));
+	}
+}
+
+void Pipeline::createOffscreenImages()
+{
+	swapChainImageFormat = vk::Format::eR8G8B8A8Srgb;
+	swapChainExtent      = parent.getWindowSize();
+
+	for(int i = 0; i < Renderer::MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		Image image = parent.createImage(
+			swapChainExtent.width,
+			swapChainExtent.height,
+			swapChainImageFormat,
+			vk::ImageTiling::eOptimal,
+			vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+			vk::MemoryPropertyFlagBits::eDeviceLocal
+		);
+
+		swapChainImages.push_back(image);
+		offscreenImages.emplace_back(std::move(image));
+	}
 }
 
 std::vector<char> Pipeline::readFile(const path& filepath)
@@ -162,7 +228,7 @@ void Pipeline::createRenderPass()
 		vk::AttachmentLoadOp::eDontCare,
 		vk::AttachmentStoreOp::eDontCare,
 		vk::ImageLayout::eUndefined,
-		vk::ImageLayout::ePresentSrcKHR
+		parent.isHeadless() ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR
 	);
 
 	vk::AttachmentDescription depthAttachment(
@@ -226,6 +292,23 @@ void Pipeline::createFramebuffers()
 	}
 }
 
+void Pipeline::createPipelines()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	createGraphicsPipeline();
+
+	if(parent.gpuCulling)
+		createCullPipeline();
+
+	std::chrono::duration<double, std::milli> time = std::chrono::steady_clock::now() - start;
+
+	// stdout may have a benchmark report.
+	std::cerr
+		<< "Pipelines created in " << time.count() << " ms ("
+		<< (parent.pipelineCache.isWarm() ? "warm" : "cold") << " cache)\n";
+}
+
 void Pipeline::createGraphicsPipeline()
 {
 
@@ -267,18 +350,8 @@ void Pipeline::createGraphicsPipeline()
 		false
 	);
 
-	vk::Viewport viewport(
-		0,
-		0,
-		swapChainExtent.width,
-		swapChainExtent.height,
-		0,
-		1
-	);
-
-	vk::Rect2D scissor(vk::Offset2D(0, 0), swapChainExtent);
-
-	vk::PipelineViewportStateCreateInfo viewportState({}, viewport, scissor);
+	// Set when recording, see setDynamicState().
+	vk::PipelineViewportStateCreateInfo viewportState({}, 1, nullptr, 1, nullptr);
 
 	vk::PipelineRasterizationStateCreateInfo rasterizer(
 		{},
@@ -338,10 +411,9 @@ void Pipeline::createGraphicsPipeline()
 
 	vk::DynamicState dynamicStates[] = {
 		vk::DynamicState::eViewport,
-		vk::DynamicState::eLineWidth
+		vk::DynamicState::eScissor
 	};
 
-	[[maybe_unused]]
 	vk::PipelineDynamicStateCreateInfo dynamicState({}, dynamicStates);
 
 	vk::PipelineLayoutCreateInfo pipelineLayoutInfo({}, *parent.descriptorSetLayout);
@@ -359,7 +431,7 @@ void Pipeline::createGraphicsPipeline()
 		&multisampling,
 		&depthStencil,
 		&colorBlending,
-		nullptr,
+		&dynamicState,
 		*pipelineLayout,
 		*renderPass,
 		0,
@@ -367,15 +439,40 @@ void Pipeline::createGraphicsPipeline()
 		-1
 	);
 
-	graphicsPipeline = parent.device.createGraphicsPipeline(nullptr, pipelineInfo);
+	graphicsPipeline = parent.device.createGraphicsPipeline(parent.pipelineCache, pipelineInfo);
 }
 
-void Pipeline::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t imageIndex)
+void Pipeline::createCullPipeline()
+{
+	auto compShaderCode   = readFile(shadersDir/"comp.spv");
+	auto compShaderModule = createShaderModule(compShaderCode);
+
+	vk::PipelineShaderStageCreateInfo compShaderStageInfo(
+		{},
+		vk::ShaderStageFlagBits::eCompute,
+		*compShaderModule,
+		"main"
+	);
+
+	// Same layout as the graphics pipeline, they share the descriptor set.
+	// Big dispatches are split with a base workgroup.
+	vk::ComputePipelineCreateInfo pipelineInfo(vk::PipelineCreateFlagBits::eDispatchBase, compShaderStageInfo, *pipelineLayout);
+
+	cullPipeline = parent.device.createComputePipeline(parent.pipelineCache, pipelineInfo);
+}
+
+void Pipeline::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t imageIndex, std::span<const vk::CommandBuffer> secondaries)
 {
 	vk::CommandBufferBeginInfo beginInfo({}, nullptr);
 
 	commandBuffer.begin(beginInfo);
 
+	parent.uploads.recordAcquires(commandBuffer);
+	parent.recordObjectCopies(commandBuffer);
+
+	if(parent.gpuCulling)
+		recordCulling(commandBuffer);
+
 	vk::ClearValue clearValues[] = {vk::ClearColorValue(0, 0, 0, 1), vk::ClearDepthStencilValue(1, 0)};
 
 	vk::RenderPassBeginInfo renderPassInfo(
@@ -385,20 +482,135 @@ void Pipeline::recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t ima
 		clearValues
 	);
 
-	commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
-	commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline);
-
-	//for(const auto& r: parent.renderables)
-	for(size_t i = 0; i < parent.renderables.size(); i++)
+	if(!secondaries.empty())
 	{
-		vk::Buffer     vertexBuffers[] = {parent.renderables[i].vertexBuffer};
-		vk::DeviceSize offsets[]       = {0};
+		commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+		commandBuffer.executeCommands(secondaries);
+	}
+	else
+	{
+		commandBuffer.beginRenderPass(renderPassInfo, vk::SubpassContents::eInline);
+
+		// Every mesh lives in the same buffers.
+		parent.geometry.bind(commandBuffer);
+		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, parent.frameData.getDescriptorSet(), parent.frameData.getUniformOffset());
+		setDynamicState(commandBuffer);
 
-		commandBuffer.bindVertexBuffers(0, vertexBuffers, offsets);
-		commandBuffer.bindIndexBuffer(parent.renderables[i].indexBuffer, 0, vk::IndexType::eUint32);
-		commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, parent.frameData.getDescriptorSet(), {});
-		commandBuffer.drawIndexed(parent.renderables[i].indexCount, 1, 0, 0, i);
+		if(parent.gpuCulling || parent.multiDrawIndirect)
+		{
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline);
+
+			recordIndirectDraws(commandBuffer);
+		}
+		else
+			recordDirectDraws(commandBuffer, parent.batches, parent.batchKeys);
 	}
+
 	commandBuffer.endRenderPass();
 	commandBuffer.end();
 }
+
+void Pipeline::recordSecondary(vk::CommandBuffer commandBuffer, uint32_t imageIndex, std::span<const vk::DrawIndexedIndirectCommand> batches, std::span<const uint64_t> keys)
+{
+	vk::CommandBufferInheritanceInfo inheritanceInfo(*renderPass, 0, *swapChainFramebuffers[imageIndex]);
+
+	vk::CommandBufferBeginInfo beginInfo(
+		vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eOneTimeSubmit,
+		&inheritanceInfo
+	);
+
+	commandBuffer.begin(beginInfo);
+
+	// Nothing is inherited from the primary.
+	parent.geometry.bind(commandBuffer);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipelineLayout, 0, parent.frameData.getDescriptorSet(), parent.frameData.getUniformOffset());
+	setDynamicState(commandBuffer);
+
+	recordDirectDraws(commandBuffer, batches, keys);
+
+	commandBuffer.end();
+}
+
+void Pipeline::setDynamicState(vk::CommandBuffer commandBuffer)
+{
+	vk::Viewport viewport(
+		0,
+		0,
+		swapChainExtent.width,
+		swapChainExtent.height,
+		0,
+		1
+	);
+
+	vk::Rect2D scissor(vk::Offset2D(0, 0), swapChainExtent);
+
+	commandBuffer.setViewport(0, viewport);
+	commandBuffer.setScissor(0, scissor);
+}
+
+void Pipeline::recordDirectDraws(vk::CommandBuffer commandBuffer, std::span<const vk::DrawIndexedIndirectCommand> batches, std::span<const uint64_t> keys)
+{
+	std::optional<uint32_t> boundPipeline;
+
+	for(size_t i = 0; i < batches.size(); i++)
+	{
+		uint32_t pipeline = DrawKey::pipeline(keys[i]);
+
+		if(pipeline != boundPipeline)
+		{
+			// Pipeline 0 is the only one, see DrawKey.
+			commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline);
+			boundPipeline = pipeline;
+		}
+
+		// Materials have no bindings yet, meshes share the geometry buffer.
+
+		const auto& batch = batches[i];
+
+		commandBuffer.drawIndexed(batch.indexCount, batch.instanceCount, batch.firstIndex, batch.vertexOffset, batch.firstInstance);
+	}
+}
+
+void Pipeline::recordIndirectDraws(vk::CommandBuffer commandBuffer)
+{
+	constexpr uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+
+	vk::Buffer indirectBuffer = parent.frameData.getIndirectBuffer();
+	uint32_t   drawCount      = parent.batches.size();
+
+	// One command per visible mesh.
+	for(uint32_t first = 0; first < drawCount; first += parent.maxDrawIndirectCount)
+	{
+		uint32_t count = std::min(parent.maxDrawIndirectCount, drawCount - first);
+
+		commandBuffer.drawIndexedIndirect(indirectBuffer, first*stride, count, stride);
+	}
+}
+
+void Pipeline::recordCulling(vk::CommandBuffer commandBuffer)
+{
+	using enum vk::AccessFlagBits;
+	using enum vk::PipelineStageFlagBits;
+
+	uint32_t batchCount = parent.batches.size();
+
+	if(batchCount == 0)
+		return;
+
+	// The CPU wrote every batch with all its objects, one workgroup keeps
+	// the visible ones.
+	commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, *cullPipeline);
+	commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0, parent.frameData.getDescriptorSet(), parent.frameData.getUniformOffset());
+
+	// gl_WorkGroupID includes the base, so it's still the batch.
+	for(uint32_t first = 0; first < batchCount; first += parent.maxCullWorkGroups)
+	{
+		uint32_t count = std::min(parent.maxCullWorkGroups, batchCount - first);
+
+		commandBuffer.dispatchBase(first, 0, 0, count, 1, 1);
+	}
+
+	// The vertex shader reads the instance buffer.
+	vk::MemoryBarrier cullBarrier(eShaderWrite, eIndirectCommandRead | eShaderRead);
+	commandBuffer.pipelineBarrier(eComputeShader, eDrawIndirect | eVertexShader, {}, cullBarrier, nullptr, nullptr);
+}
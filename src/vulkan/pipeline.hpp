@@ -41,26 +41,50 @@ public:
 	vk::Extent2D                     swapChainExtent;
 	std::vector<vk::raii::ImageView> swapChainImageViews;
 
+	// One per image, a frame in flight can't know when the presentation
+	// of its previous image finished.
+	std::vector<vk::raii::Semaphore> renderFinished;
+
+	// Headless render targets, they take the place of the swap chain images.
+	std::vector<Image> offscreenImages;
+
 	Depth depth;
 
 	vk::raii::RenderPass               renderPass       = nullptr;
 	vk::raii::PipelineLayout           pipelineLayout   = nullptr;
 	vk::raii::Pipeline                 graphicsPipeline = nullptr;
+	vk::raii::Pipeline                 cullPipeline     = nullptr;
 	std::vector<vk::raii::Framebuffer> swapChainFramebuffers;
 
 	Pipeline(Renderer& parent);
 	void create();
+	/// Rebuilds what depends on the extent or the present mode.
 	void recreate();
 
-	void recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t imageIndex);
+	/// The render pass only executes secondaries when there are any.
+	void recordCommandBuffer(vk::CommandBuffer commandBuffer, uint32_t imageIndex, std::span<const vk::CommandBuffer> secondaries = {});
+	void recordSecondary(vk::CommandBuffer commandBuffer, uint32_t imageIndex, std::span<const vk::DrawIndexedIndirectCommand> batches, std::span<const uint64_t> keys);
+
+	/// Batches are sorted by their DrawKey, so only state changes are bound.
+	void recordDirectDraws(vk::CommandBuffer commandBuffer, std::span<const vk::DrawIndexedIndirectCommand> batches, std::span<const uint64_t> keys);
+	void recordIndirectDraws(vk::CommandBuffer commandBuffer);
+	void recordCulling(vk::CommandBuffer commandBuffer);
 
 private:
 	void createImageViews();
-	void createSwapChain(vk::PhysicalDevice physicalDevice);
+	void createSwapChain(vk::PhysicalDevice physicalDevice, vk::SwapchainKHR oldSwapChain = nullptr);
+	void createOffscreenImages();
 
 	static std::vector<char> readFile(const path& filepath);
 	vk::raii::ShaderModule createShaderModule(std::span<char> code);
 	void createRenderPass();
 	void createFramebuffers();
 	void createGraphicsPipeline();
+	void createCullPipeline();
+
+	/// Graphics and compute pipelines, they survive swap chain recreations.
+	void createPipelines();
+
+	/// Viewport and scissor of the current extent.
+	void setDynamicState(vk::CommandBuffer commandBuffer);
 };
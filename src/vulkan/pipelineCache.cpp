@@ -0,0 +1,149 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "../config.hpp"
+#include "pipelineCache.hpp"
+#include "renderer.hpp"
+
+PipelineCache::PipelineCache(Renderer& root):
+	root(root)
+{}
+
+void PipelineCache::create()
+{
+	path = cacheDir/"pipelines.cache";
+
+	std::vector<char> data = load();
+
+	warm = !data.empty();
+
+	vk::PipelineCacheCreateInfo cacheInfo({}, data.size(), data.data());
+
+	cache = root.device.createPipelineCache(cacheInfo);
+}
+
+PipelineCache::Header PipelineCache::makeHeader() const
+{
+	vk::PhysicalDeviceProperties properties = root.physicalDevice.getProperties();
+
+	Header header
+	{
+		.magic             = Header::MAGIC,
+		.version           = Header::VERSION,
+		.vendorID          = properties.vendorID,
+		.deviceID          = properties.deviceID,
+		.driverVersion     = properties.driverVersion,
+		.pipelineCacheUUID = {},
+		.dataSize          = 0
+	};
+
+	std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+
+	return header;
+}
+
+std::vector<char> PipelineCache::load() const
+{
+	std::ifstream file(path, std::ios::binary);
+
+	if(!file.is_open())
+		return {};
+
+	Header expected = makeHeader();
+	Header header;
+
+	if(!file.read((char*)&header, sizeof(header)))
+		return {};
+
+	// Another device or driver, the data would be rejected or worse.
+	if(header.magic != expected.magic ||
+		header.version != expected.version ||
+		header.vendorID != expected.vendorID ||
+		header.deviceID != expected.deviceID ||
+		header.driverVersion != expected.driverVersion ||
+		std::memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return {};
+
+	// A truncated or corrupted file can carry any size, don't trust it.
+	std::error_code ec;
+	uintmax_t fileSize = std::filesystem::file_size(path, ec);
+
+	if(ec || fileSize < sizeof(header) || header.dataSize != fileSize - sizeof(header))
+		return {};
+
+	std::vector<char> data(header.dataSize);
+
+	if(!file.read(data.data(), data.size()))
+		return {};
+
+	return data;
+}
+
+bool PipelineCache::save() const
+{
+	if(!*cache)
+		return false;
+
+	std::vector<uint8_t> data = cache.getData();
+
+	Header header = makeHeader();
+	header.dataSize = data.size();
+
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+
+	std::filesystem::path tmp = path;
+	tmp += ".tmp";
+
+	{
+		std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)data.data(), data.size());
+
+		if(!file.flush())
+		{
+			std::cerr << "Failed to write " << tmp << '\n';
+			std::filesystem::remove(tmp, ec);
+			return false;
+		}
+	}
+
+	std::filesystem::rename(tmp, path, ec);
+
+	if(ec)
+	{
+		std::cerr << "Failed to save " << path << ": " << ec.message() << '\n';
+		std::filesystem::remove(tmp, ec);
+		return false;
+	}
+
+	return true;
+}
+
+bool PipelineCache::isWarm() const
+{
+	return warm;
+}
+
+PipelineCache::operator vk::PipelineCache() const
+{
+	return *cache;
+}
@@ -0,0 +1,71 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+class Renderer;
+
+/// Pipeline cache persisted in the XDG cache directory between runs.
+class PipelineCache
+{
+private:
+	/// Written before the Vulkan data, which is only trusted on the same
+	/// device and driver.
+	struct Header
+	{
+		static constexpr uint32_t MAGIC   = 0x43504b56; // "VKPC"
+		static constexpr uint32_t VERSION = 1;
+
+		uint32_t magic;
+		uint32_t version;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t  pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+	};
+
+	Renderer& root;
+
+	vk::raii::PipelineCache cache = nullptr;
+
+	std::filesystem::path path;
+
+	// The cache had data from a previous run.
+	bool warm = false;
+
+	Header makeHeader() const;
+	std::vector<char> load() const;
+
+public:
+	PipelineCache(Renderer& root);
+
+	void create();
+
+	/// Writes a temporary file and renames it, so an interrupted save never
+	/// leaves a truncated cache. Returns false on failure.
+	bool save() const;
+
+	bool isWarm() const;
+
+	operator vk::PipelineCache() const;
+};
@@ -8,6 +8,9 @@ struct QueueFamilyIndices
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
 
+	// Transfer only, uploads use the graphics family without it.
+	std::optional<uint32_t> transferFamily;
+
 	bool isComplete()
 	{
 		return graphicsFamily.has_value() && presentFamily.has_value();
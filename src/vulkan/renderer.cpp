@@ -15,6 +15,7 @@
 // along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <algorithm>
+#include <bit>
 #include <chrono>
 #include <cstring>
 #include <cstring>
@@ -23,14 +24,20 @@
 #include <limits>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <stb/stb_image.h>
+#include <taskflow/taskflow.hpp>
+#include <taskflow/algorithm/for_each.hpp>
 
 #include "../config.hpp"
 #include "../engine.hpp"
+#include "../math/batch.hpp"
+#include "../math/frustum.hpp"
 #include "../scene.hpp"
 #include "../utils.hpp"
 #include "../vertex.hpp"
@@ -40,6 +47,9 @@
 
 Renderer::Renderer(Engine& engine):
 	allocator(*this),
+	uploads(*this),
+	geometry(*this),
+	pipelineCache(*this),
 	frameData(*this),
 	pipeline(*this),
 	engine(engine)
@@ -47,13 +57,21 @@ Renderer::Renderer(Engine& engine):
 
 Renderer::~Renderer() noexcept
 {
+	// Frames may still be in flight.
+	if(*device)
+	{
+		device.waitIdle();
+		pipelineCache.save();
+	}
+
 	cleanup();
 	if(activeScene)
 	{
 		for(auto& mesh: activeScene->meshes)
 		{
-			mesh.vertexBuffer.clear();
-			mesh.indexBuffer.clear();
+			// Freed with the geometry buffer.
+			mesh.vertexRange = {};
+			mesh.indexRange  = {};
 		}
 	}
 }
@@ -65,15 +83,61 @@ void Renderer::init()
 	engine.setRenderer(this);
 
 	activeScene = &engine.getActiveScene();
-	activeScene->uploadToGpu(*this);
+	sceneUploaded = activeScene->uploadToGpu(*this);
 }
 
-void Renderer::update([[maybe_unused]] float delta, void*)
+void Renderer::update([[maybe_unused]] float delta, void* sbf_p)
 {
-	renderables = activeScene->getRenderables();
-	drawFrame();
+	tf::Subflow* sbf = (tf::Subflow*)sbf_p;
+
+	// Written by the previous simulation step, the current one writes the other snapshot.
+	const RenderSnapshot& snapshot = engine.getRenderSnapshot();
+
+	renderables = snapshot.renderables;
+
+	// Each frame in flight has its own copy of the objects.
+	frameData.markObjectsDirty(snapshot.dirty);
+
+	tf::Task begin   = sbf->emplace([this](){frameReady = beginFrame();});
+	tf::Task prepare = sbf->emplace([this](){if(frameReady) prepareFrame();});
+	tf::Task submit  = sbf->emplace([this](){if(frameReady) submitFrame();});
+
+	tf::Task record = sbf->for_each_index(size_t(0), frameData.getSecondaryCount(), size_t(1), [this](size_t chunk){
+		if(frameReady && parallelRecording)
+			recordSecondary(chunk);
+	});
+
+	prepare.precede(record);
+	record.precede(submit);
+
+	// Batches are sorted by depth on both paths.
+	updateBounds(snapshot.dirty);
+
+	// The GPU culls the batches.
+	if(gpuCulling)
+	{
+		begin.precede(prepare);
+		return;
+	}
+
+	size_t chunks = (renderables.size() + CULL_CHUNK_SIZE - 1) / CULL_CHUNK_SIZE;
+
+	visibleObjects.resize(renderables.size());
+	visibleCounts.resize(chunks);
+
+	// The frustum is known after beginFrame().
+	tf::Task cull = sbf->for_each_index(size_t(0), chunks, size_t(1), [this](size_t chunk){
+		if(!frameReady)
+			return;
 
-	device.waitIdle();
+		uint32_t first = chunk * CULL_CHUNK_SIZE;
+		uint32_t last  = std::min<size_t>(first + CULL_CHUNK_SIZE, renderables.size());
+
+		visibleCounts[chunk] = math::cullAabbs(bounds, frustum, first, last, visibleObjects.data() + first);
+	});
+
+	begin.precede(cull);
+	cull.precede(prepare);
 }
 
 void Renderer::setActiveScene(Scene* scene)
@@ -87,14 +151,18 @@ void Renderer::initVulkan()
 #ifdef VK_DEBUG
 	setupDebugMessenger();
 #endif
-	createSurface();
+	if(!isHeadless())
+		createSurface();
 	pickPhysicalDevice();
 	createLogicalDevice();
 	allocator.create();
+	uploads.create();
+	geometry.create();
+	pipelineCache.create();
 	createCommandPool();
-	createTextureSampler();
 	createTextureImage();
 	createTextureImageView();
+	createTextureSampler();
 	createDescriptorSetLayout();
 	frameData.create();
 	pipeline.create();
@@ -107,6 +175,11 @@ void Renderer::cleanup()
 #endif
 }
 
+bool Renderer::isHeadless() const
+{
+	return engine.getOptions().headless;
+}
+
 void Renderer::createInstance()
 {
 #ifdef VK_DEBUG
@@ -146,17 +219,22 @@ void Renderer::createInstance()
 
 	for(const auto& i: vk::enumerateInstanceExtensionProperties())
 	{
-		std::cout << '\t' << i.extensionName << '\n';
+		std::cerr << '\t' << i.extensionName << '\n';
 	}
 }
 
 std::vector<const char*> Renderer::getRequiredExtensions()
 {
-	uint32_t glfwExtensionCount = 0;
-	const char** glfwExtensions;
-	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+	std::vector<const char*> extensions;
 
-	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	if(!isHeadless())
+	{
+		uint32_t glfwExtensionCount = 0;
+		const char** glfwExtensions;
+		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+
+		extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	}
 
 #ifdef VK_DEBUG
 	extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -275,8 +353,9 @@ bool Renderer::isDeviceSuitable(vk::PhysicalDevice physicalDevice)
 
 	bool extensionsSupported = checkDeviceExtensionSupport(physicalDevice);
 
-	bool swapChainAdequate = false;
-	if(extensionsSupported)
+	// Nothing is presented in headless mode.
+	bool swapChainAdequate = isHeadless();
+	if(extensionsSupported && !isHeadless())
 	{
 		SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 		swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -284,10 +363,20 @@ bool Renderer::isDeviceSuitable(vk::PhysicalDevice physicalDevice)
 
 	vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
 
+	bool timelineSemaphore = false;
+
+	if(physicalDevice.getProperties().apiVersion >= VK_API_VERSION_1_2)
+	{
+		auto features2 = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+
+		timelineSemaphore = features2.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore;
+	}
+
 	return indices.isComplete() &&
 		extensionsSupported &&
 		swapChainAdequate &&
-		supportedFeatures.samplerAnisotropy
+		supportedFeatures.samplerAnisotropy &&
+		timelineSemaphore
 	;
 }
 
@@ -300,10 +389,18 @@ QueueFamilyIndices Renderer::findQueueFamilies(vk::PhysicalDevice device)
 		if(queueFamily.queueFlags & vk::QueueFlagBits::eGraphics)
 			indices.graphicsFamily = i;
 
-		VkBool32 presentSupport = device.getSurfaceSupportKHR(i, *surface);
+		if(isHeadless())
+		{
+			// There is no surface, the present queue is never used.
+			indices.presentFamily = indices.graphicsFamily;
+		}
+		else
+		{
+			VkBool32 presentSupport = device.getSurfaceSupportKHR(i, *surface);
 
-		if(presentSupport)
-			indices.presentFamily = i;
+			if(presentSupport)
+				indices.presentFamily = i;
+		}
 
 		if(indices.isComplete())
 			break;
@@ -311,16 +408,39 @@ QueueFamilyIndices Renderer::findQueueFamilies(vk::PhysicalDevice device)
 		i++;
 	}
 
+	// Copies there don't compete with rendering.
+	for(uint32_t i = 0; const auto& queueFamily: device.getQueueFamilyProperties())
+	{
+		using enum vk::QueueFlagBits;
+
+		if((queueFamily.queueFlags & eTransfer) && !(queueFamily.queueFlags & (eGraphics | eCompute)))
+		{
+			indices.transferFamily = i;
+			break;
+		}
+
+		i++;
+	}
 
 	return indices;
 }
 
+std::vector<const char*> Renderer::getRequiredDeviceExtensions() const
+{
+	if(isHeadless())
+		return {};
+
+	return {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+}
+
 void Renderer::createLogicalDevice()
 {
 	QueueFamilyIndices indices = findQueueFamilies(*physicalDevice);
 
 	std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
-	small_flat_set<uint32_t, 2> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+	uint32_t transferFamily = indices.transferFamily.value_or(indices.graphicsFamily.value());
+
+	small_flat_set<uint32_t, 3> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value(), transferFamily};
 
 	float queuePriority[] = {1.0f};
 
@@ -329,12 +449,44 @@ void Renderer::createLogicalDevice()
 		queueCreateInfos.emplace_back(vk::DeviceQueueCreateInfo({}, queueFamily, queuePriority));
 	}
 
+	vk::PhysicalDeviceFeatures supportedFeatures = physicalDevice.getFeatures();
+
+	// Objects are indexed with firstInstance, so both are needed.
+	multiDrawIndirect = supportedFeatures.multiDrawIndirect && supportedFeatures.drawIndirectFirstInstance;
+
+	if(multiDrawIndirect)
+		maxDrawIndirectCount = physicalDevice.getProperties().limits.maxDrawIndirectCount;
+
+	// The culling pass writes the instance counts of the indirect batches.
+	gpuCulling = multiDrawIndirect;
+
+	if(gpuCulling)
+		maxCullWorkGroups = physicalDevice.getProperties().limits.maxComputeWorkGroupCount[0];
+
 	vk::PhysicalDeviceFeatures deviceFeatures;
-	deviceFeatures.samplerAnisotropy = true;
+	deviceFeatures.samplerAnisotropy         = true;
+	deviceFeatures.multiDrawIndirect         = multiDrawIndirect;
+	deviceFeatures.drawIndirectFirstInstance = multiDrawIndirect;
 
 	// For storage buffers
 	vk::PhysicalDeviceShaderDrawParametersFeatures drawFeatures(true);
 
+	vk::PhysicalDeviceVulkan12Features vulkan12Features;
+	vulkan12Features.timelineSemaphore = true; // For uploads
+
+	drawFeatures.pNext = &vulkan12Features;
+
+	auto deviceExtensions = getRequiredDeviceExtensions();
+
+	for(const auto& extension: physicalDevice.enumerateDeviceExtensionProperties())
+	{
+		if(std::string_view(extension.extensionName) == VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)
+			memoryBudget = true;
+	}
+
+	if(memoryBudget)
+		deviceExtensions.emplace_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
 	vk::DeviceCreateInfo createInfo(
 		{},
 		queueCreateInfos,
@@ -348,6 +500,7 @@ void Renderer::createLogicalDevice()
 
 	graphicsQueue = device.getQueue(indices.graphicsFamily.value(), 0);
 	presentQueue  = device.getQueue(indices.presentFamily.value(), 0);
+	transferQueue = device.getQueue(transferFamily, 0);
 }
 
 void Renderer::createSurface()
@@ -377,7 +530,7 @@ bool Renderer::checkDeviceExtensionSupport([[maybe_unused]]vk::PhysicalDevice de
 	std::vector<std::string> available;
 	std::vector<std::string> missing;
 
-	for(const auto& extension: deviceExtensions)
+	for(const auto& extension: getRequiredDeviceExtensions())
 	{
 		required.emplace_back(extension);
 	}
@@ -406,51 +559,132 @@ SwapChainSupportDetails Renderer::querySwapChainSupport(vk::PhysicalDevice devic
 	return {engine.getSettings(), device, *surface};
 }
 
-void Renderer::drawFrame()
+bool Renderer::beginFrame()
 {
-	[[maybe_unused]]
-	auto r = device.waitForFences(frameData.getInFlight(), true, std::numeric_limits<uint64_t>::max());
+	frameData.waitFrame();
 
-	auto [result, imageIndex] = pipeline.swapChain.acquireNextImage(
-		std::numeric_limits<uint64_t>::max(),
-		frameData.getImageAvailable(),
-		nullptr
-	);
+	frameData.flushDeletionQueues();
+	frameData.resetSecondaryCommandPools();
+	frameData.getTransient().reset();
+
+	// Headless mode has an offscreen image for each frame in flight.
+	imageIndex = frameData.getCurrentFrame();
 
-	if(result == vk::Result::eErrorOutOfDateKHR)
+	vk::Result result;
+
+	if(!isHeadless())
 	{
-		pipeline.recreate();
-		return;
+		std::tie(result, imageIndex) = pipeline.swapChain.acquireNextImage(
+			std::numeric_limits<uint64_t>::max(),
+			frameData.getImageAvailable(),
+			nullptr
+		);
+
+		if(result == vk::Result::eErrorOutOfDateKHR)
+		{
+			pipeline.recreate();
+			return false;
+		}
+		else if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR)
+			throw std::runtime_error("failed to acquire swap chain image!");
 	}
-	else if (result != vk::Result::eSuccess && result != vk::Result::eSuboptimalKHR)
-		throw std::runtime_error("failed to acquire swap chain image!");
 
 	updateUniformBuffer();
+
+	return true;
+}
+
+void Renderer::prepareFrame()
+{
 	updateStorageBuffer();
 
-	device.resetFences(frameData.getInFlight());
+	if(gpuCulling)
+		listObjects();
+	else
+		compactVisibleObjects();
+
+	buildBatches();
+
+	if(multiDrawIndirect)
+		updateIndirectBuffer();
+
+	frameData.getTransient().flush();
+
+	// Indirect draws are recorded in constant time.
+	parallelRecording = !gpuCulling && !multiDrawIndirect && batches.size() >= PARALLEL_RECORDING_THRESHOLD;
+}
+
+void Renderer::recordSecondary(size_t chunk)
+{
+	size_t chunks = frameData.getSecondaryCount();
+
+	size_t first = batches.size() * chunk / chunks;
+	size_t last  = batches.size() * (chunk + 1) / chunks;
+
+	pipeline.recordSecondary(
+		frameData.getSecondaryCommandBuffer(chunk),
+		imageIndex,
+		std::span<const vk::DrawIndexedIndirectCommand>(batches).subspan(first, last - first),
+		std::span<const uint64_t>(batchKeys).subspan(first, last - first)
+	);
+}
 
+void Renderer::submitFrame()
+{
 	frameData.getCommandBuffer().reset();
-	pipeline.recordCommandBuffer(frameData.getCommandBuffer(), imageIndex);
 
-	vk::Semaphore          waitSemaphores[]   = {frameData.getImageAvailable()};
-	vk::PipelineStageFlags waitStages[]       = {vk::PipelineStageFlagBits::eColorAttachmentOutput};
+	// Copies recorded since the last frame, the GPU waits for them instead
+	// of the CPU.
+	// The first frame can't start before the scene is uploaded.
+	UploadToken uploaded = std::max(uploads.submit(), sceneUploaded);
+
+	if(parallelRecording)
+		pipeline.recordCommandBuffer(frameData.getCommandBuffer(), imageIndex, frameData.getSecondaryCommandBuffers());
+	else
+		pipeline.recordCommandBuffer(frameData.getCommandBuffer(), imageIndex);
+
+	if(isHeadless())
+	{
+		vk::Semaphore          waitSemaphores[]   = {uploads.getSemaphore()};
+		vk::PipelineStageFlags waitStages[]       = {UploadManager::WAIT_STAGES};
+		uint64_t               waitValues[]       = {uploaded};
+		vk::CommandBuffer      commandBuffers[]   = {frameData.getCommandBuffer()};
+		vk::Semaphore          signalSemaphores[] = {frameData.getTimeline()};
+		uint64_t               signalValues[]     = {frameData.signalFrame()};
+
+		vk::TimelineSemaphoreSubmitInfo timelineInfo(waitValues, signalValues);
+
+		vk::SubmitInfo submitInfo(waitSemaphores, waitStages, commandBuffers, signalSemaphores, &timelineInfo);
+
+		graphicsQueue.submit(submitInfo);
+
+		frameData.incrementFrame();
+		return;
+	}
+
+	vk::Semaphore          waitSemaphores[]   = {frameData.getImageAvailable(), uploads.getSemaphore()};
+	vk::PipelineStageFlags waitStages[]       = {vk::PipelineStageFlagBits::eColorAttachmentOutput, UploadManager::WAIT_STAGES};
+	uint64_t               waitValues[]       = {0, uploaded}; // Binary semaphores ignore it
 	vk::CommandBuffer      commandBuffers[]   = {frameData.getCommandBuffer()};
-	vk::Semaphore          signalSemaphores[] = {frameData.getRenderFinished()};
+	vk::Semaphore          signalSemaphores[] = {*pipeline.renderFinished[imageIndex], frameData.getTimeline()};
+	uint64_t               signalValues[]     = {0, frameData.signalFrame()};
 
-	vk::SubmitInfo submitInfo(waitSemaphores, waitStages, commandBuffers, signalSemaphores);
+	vk::TimelineSemaphoreSubmitInfo timelineInfo(waitValues, signalValues);
 
-	graphicsQueue.submit(submitInfo, frameData.getInFlight());
+	vk::SubmitInfo submitInfo(waitSemaphores, waitStages, commandBuffers, signalSemaphores, &timelineInfo);
 
-	vk::SwapchainKHR swapChains[] = {*pipeline.swapChain};
+	graphicsQueue.submit(submitInfo);
+
+	vk::Semaphore    presentSemaphores[] = {*pipeline.renderFinished[imageIndex]};
+	vk::SwapchainKHR swapChains[]        = {*pipeline.swapChain};
 
 	vk::PresentInfoKHR presentInfo(
-		signalSemaphores,
+		presentSemaphores,
 		swapChains,
 		imageIndex
 	);
 
-	result = presentQueue.presentKHR(presentInfo);
+	vk::Result result = presentQueue.presentKHR(presentInfo);
 
 	if(result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR || framebufferResized || engine.getSettings().hasChanged())
 	{
@@ -468,22 +702,13 @@ void Renderer::framebufferResizeCallback(GLFWwindow* window, int, int)
 	framebufferResized = true;
 }
 
-void Renderer::copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size)
-{
-	auto singleCommand = makeSingleCommand();
-
-	vk::BufferCopy copyRegion(0, 0, size);
-
-	singleCommand.getBuffer().copyBuffer(srcBuffer, dstBuffer, copyRegion);
-}
-
 void Renderer::createDescriptorSetLayout()
 {
 	vk::DescriptorSetLayoutBinding uboLayoutBinding(
 		0,
-		vk::DescriptorType::eUniformBuffer,
+		vk::DescriptorType::eUniformBufferDynamic,
 		1,
-		vk::ShaderStageFlagBits::eVertex,
+		vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute,
 		nullptr
 	);
 
@@ -491,7 +716,7 @@ void Renderer::createDescriptorSetLayout()
 		1,
 		vk::DescriptorType::eStorageBuffer,
 		1,
-		vk::ShaderStageFlagBits::eVertex,
+		vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute,
 		nullptr
 	);
 
@@ -503,11 +728,29 @@ void Renderer::createDescriptorSetLayout()
 		nullptr
 	);
 
+	vk::DescriptorSetLayoutBinding drawCommandLayoutBinding(
+		3,
+		vk::DescriptorType::eStorageBuffer,
+		1,
+		vk::ShaderStageFlagBits::eCompute,
+		nullptr
+	);
+
+	vk::DescriptorSetLayoutBinding instanceLayoutBinding(
+		4,
+		vk::DescriptorType::eStorageBuffer,
+		1,
+		vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eCompute,
+		nullptr
+	);
+
 	vk::DescriptorSetLayoutBinding bindings[] =
 	{
 		uboLayoutBinding,
 		ssboLayoutBinding,
-		samplerLayoutBinding
+		samplerLayoutBinding,
+		drawCommandLayoutBinding,
+		instanceLayoutBinding
 	};
 
 	vk::DescriptorSetLayoutCreateInfo layoutInfo({}, bindings);
@@ -531,32 +774,264 @@ void Renderer::updateUniformBuffer()
 
 	ubo.projView = ubo.proj * ubo.view;
 
-	Buffer& uboBuffer = frameData.getUniformBuffer();
+	frustum = math::frustumPlanes(ubo.projView);
+	std::ranges::copy(frustum, ubo.frustum);
 
-	memcpy(uboBuffer.allocationInfo.pMappedData, &ubo, sizeof(ubo));
-	uboBuffer.flush();
+	frameData.pushUniforms(ubo);
 }
 
 void Renderer::updateStorageBuffer()
 {
+	frameData.reserveObjects(renderables.size());
+
 	Buffer& ssboBuffer = frameData.getStorageBuffer();
 
-	auto* ssbo = (ShaderStorageBufferObject*)ssboBuffer.allocationInfo.pMappedData;
+	objectCopies.clear();
 
-	assert(renderables.size() < FrameData::MAX_OBJECTS);
+	auto dirtyObjects = frameData.getDirtyObjects();
 
-	for(size_t i = 0; i < renderables.size(); i++)
+	if(dirtyObjects.empty())
+		return;
+
+	// Sorted, so runs of objects are contiguous in the buffer. Trailing
+	// slots may have been trimmed since they were marked.
+	uploadObjects.clear();
+
+	for(uint32_t i: dirtyObjects)
+	{
+		if(i < renderables.size())
+			uploadObjects.push_back(i);
+	}
+
+	std::ranges::sort(uploadObjects);
+
+	uploadModels.clear();
+
+	// Static objects are written once per frame in flight.
+	for(uint32_t i: uploadObjects)
 	{
-		ssbo[i].model        = renderables[i].transform;
-		ssbo[i].normalMatrix = glm::transpose(glm::inverse(renderables[i].transform));
+		uploadModels.push_back(renderables[i].empty() ? glm::mat4(1) : renderables[i].transform);
 	}
 
-	ssboBuffer.flush();
+	uploadNormals.resize(uploadModels.size());
+	math::normalMatrices(uploadModels, uploadNormals);
+
+	uploadData.resize(uploadObjects.size());
+
+	for(size_t j = 0; j < uploadObjects.size(); j++)
+	{
+		uint32_t                   i      = uploadObjects[j];
+		ShaderStorageBufferObject& object = uploadData[j];
+
+		vk::DrawIndexedIndirectCommand command = getDrawCommand(i);
+
+		object.model        = uploadModels[j];
+		object.normalMatrix = uploadNormals[j];
+		object.draw         = glm::uvec4(command.indexCount, command.firstIndex, command.vertexOffset, 0);
+
+		if(renderables[i].empty())
+		{
+			object.aabbMin = glm::vec4(0);
+			object.aabbMax = glm::vec4(0);
+			continue;
+		}
+
+		const Mesh& mesh = activeScene->meshes[renderables[i].mesh];
+
+		object.aabbMin = glm::vec4(mesh.aabbMin, 1);
+		object.aabbMax = glm::vec4(mesh.aabbMax, 1);
+	}
+
+	frameData.clearDirtyObjects();
+
+	// Device local memory the CPU can't see is copied from the staging
+	// buffer at the start of the frame.
+	bool    mapped  = ssboBuffer.allocationInfo.pMappedData;
+	Buffer& written = mapped ? ssboBuffer : frameData.getObjectStaging();
+
+	auto* ssbo = (ShaderStorageBufferObject*)written.allocationInfo.pMappedData;
+
+	for(size_t j = 0; j < uploadObjects.size(); j++)
+	{
+		ssbo[uploadObjects[j]] = uploadData[j];
+	}
+
+	written.flush();
+
+	if(mapped)
+		return;
+
+	for(size_t first = 0, last; first < uploadObjects.size(); first = last)
+	{
+		for(last = first + 1; last < uploadObjects.size() && uploadObjects[last] == uploadObjects[last - 1] + 1; last++);
+
+		vk::DeviceSize offset = uploadObjects[first] * sizeof(ShaderStorageBufferObject);
+
+		objectCopies.emplace_back(offset, offset, (last - first) * sizeof(ShaderStorageBufferObject));
+	}
+}
+
+void Renderer::recordObjectCopies(vk::CommandBuffer commandBuffer)
+{
+	using enum vk::PipelineStageFlagBits;
+
+	if(objectCopies.empty())
+		return;
+
+	commandBuffer.copyBuffer(frameData.getObjectStaging().buffer, frameData.getStorageBuffer().buffer, objectCopies);
+
+	vk::MemoryBarrier copyBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead);
+	commandBuffer.pipelineBarrier(eTransfer, eVertexShader | eComputeShader, {}, copyBarrier, nullptr, nullptr);
+}
+
+vk::DrawIndexedIndirectCommand Renderer::getDrawCommand(uint32_t object) const
+{
+	const Renderable& renderable = renderables[object];
+
+	// Free slots draw nothing.
+	if(renderable.empty())
+		return vk::DrawIndexedIndirectCommand(0, 0, 0, 0, object);
+
+	const Mesh& mesh = activeScene->meshes[renderable.mesh];
+
+	return vk::DrawIndexedIndirectCommand(
+		mesh.getIndexCount(),
+		1,
+		mesh.getFirstIndex(),
+		mesh.getVertexOffset(),
+		object
+	);
+}
+
+void Renderer::updateBounds(std::span<const uint32_t> objects)
+{
+	bounds.resize(renderables.size());
+
+	for(uint32_t i: objects)
+	{
+		if(renderables[i].empty())
+		{
+			bounds.setEmpty(i);
+			continue;
+		}
+
+		const Mesh&      mesh  = activeScene->meshes[renderables[i].mesh];
+		const glm::mat4& model = renderables[i].transform;
+
+		glm::vec3 center = (mesh.aabbMax + mesh.aabbMin) * 0.5f;
+		glm::vec3 extent = (mesh.aabbMax - mesh.aabbMin) * 0.5f;
+
+		// World space box that contains the transformed one.
+		glm::vec3 worldCenter = model * glm::vec4(center, 1);
+		glm::vec3 worldExtent =
+			glm::abs(glm::vec3(model[0])) * extent.x +
+			glm::abs(glm::vec3(model[1])) * extent.y +
+			glm::abs(glm::vec3(model[2])) * extent.z;
+
+		bounds.set(i, worldCenter, worldExtent);
+	}
+}
+
+void Renderer::compactVisibleObjects()
+{
+	uint32_t count = 0;
+
+	for(size_t chunk = 0; chunk < visibleCounts.size(); chunk++)
+	{
+		auto first = visibleObjects.begin() + chunk * CULL_CHUNK_SIZE;
+
+		if(first != visibleObjects.begin() + count)
+			std::copy_n(first, visibleCounts[chunk], visibleObjects.begin() + count);
+
+		count += visibleCounts[chunk];
+	}
+
+	visible = std::span(visibleObjects).first(count);
+}
+
+void Renderer::listObjects()
+{
+	visibleObjects.clear();
+
+	for(uint32_t i = 0; i < renderables.size(); i++)
+	{
+		if(!renderables[i].empty())
+			visibleObjects.push_back(i);
+	}
+
+	visible = visibleObjects;
+}
+
+void Renderer::buildBatches()
+{
+	const auto& meshes = activeScene->meshes;
+
+	const glm::vec4& nearPlane = frustum[4];
+	const glm::vec4& farPlane  = frustum[5];
+
+	drawList.clear();
+
+	for(uint32_t i: visible)
+	{
+		glm::vec3 center(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+
+		// 0 at the near plane and 1 at the far plane.
+		float nearDistance = glm::dot(glm::vec3(nearPlane), center) + nearPlane.w;
+		float farDistance  = glm::dot(glm::vec3(farPlane), center) + farPlane.w;
+		float depth        = nearDistance / (nearDistance + farDistance);
+
+		// One pipeline and one material, see DrawKey.
+		drawList.add(DrawKey::pack(0, 0, renderables[i].mesh, depth), i);
+	}
+
+	drawList.sort();
+
+	auto keys    = drawList.getKeys();
+	auto objects = drawList.getObjects();
+
+	Buffer& instanceBuffer = frameData.getInstanceBuffer();
+
+	std::ranges::copy(objects, (uint32_t*)instanceBuffer.allocationInfo.pMappedData);
+	instanceBuffer.flush();
+
+	batches.clear();
+	batchKeys.clear();
+
+	// Each batch is culled by one workgroup, big ones are split.
+	uint32_t maxInstances = gpuCulling ? GPU_CULL_BATCH_SIZE : std::numeric_limits<uint32_t>::max();
+
+	for(uint32_t first = 0, last; first < keys.size(); first = last)
+	{
+		uint64_t state = DrawKey::state(keys[first]);
+
+		for(last = first + 1; last < keys.size() && last - first < maxInstances && DrawKey::state(keys[last]) == state; last++);
+
+		const Mesh& mesh = meshes[DrawKey::mesh(keys[first])];
+
+		batches.emplace_back(
+			mesh.getIndexCount(),
+			last - first,
+			mesh.getFirstIndex(),
+			mesh.getVertexOffset(),
+			first
+		);
+		batchKeys.push_back(keys[first]);
+	}
+}
+
+void Renderer::updateIndirectBuffer()
+{
+	Buffer& indirectBuffer = frameData.getIndirectBuffer();
+
+	auto* commands = (vk::DrawIndexedIndirectCommand*)indirectBuffer.allocationInfo.pMappedData;
+
+	std::copy(batches.begin(), batches.end(), commands);
+
+	indirectBuffer.flush();
 }
 
 void Renderer::createTextureImage()
 {
-	using enum vk::BufferUsageFlagBits;
 	using enum vk::MemoryPropertyFlagBits;
 
 	path texture = texturesDir/"texture.jpg";
@@ -570,52 +1045,45 @@ void Renderer::createTextureImage()
 	if(!pixels)
 		throw std::runtime_error("failed to load texture image!");
 
-	Buffer stagingBuffer = allocator.createBuffer(
-		imageSize,
-		eTransferSrc,
-		eHostVisible | eHostCoherent
-	);
-
-	memcpy(stagingBuffer.allocationInfo.pMappedData, pixels, static_cast<size_t>(imageSize));
-	stagingBuffer.flush();
+	// Mip levels are blitted from the first one, which needs linear filtering.
+	vk::FormatProperties formatProperties = physicalDevice.getFormatProperties(vk::Format::eR8G8B8A8Srgb);
 
-	stbi_image_free(pixels);
+	if(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImageFilterLinear)
+		textureMipLevels = std::bit_width((uint32_t)std::max(texWidth, texHeight));
+	else
+		textureMipLevels = 1;
 
-	auto [_textureImage, _textureImageMemory] = createImage(
+	textureImage = createImage(
 		texWidth,
 		texHeight,
 		vk::Format::eR8G8B8A8Srgb,
 		vk::ImageTiling::eOptimal,
-		vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
-		eDeviceLocal
+		vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled,
+		eDeviceLocal,
+		textureMipLevels
 	);
 
-	textureImage       = std::move(_textureImage);
-	textureImageMemory = std::move(_textureImageMemory);
+	uploads.uploadImage(textureImage, {(uint32_t)texWidth, (uint32_t)texHeight, 1}, pixels, imageSize, textureMipLevels);
 
-	transitionImageLayout(*textureImage, vk::Format::eR8G8B8A8Srgb, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-	copyBufferToImage(stagingBuffer, *textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-	transitionImageLayout(*textureImage, vk::Format::eR8G8B8A8Srgb, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal);
+	stbi_image_free(pixels);
 }
 
-std::pair<vk::raii::Image, vk::raii::DeviceMemory> Renderer::createImage(
+Image Renderer::createImage(
 	uint32_t width,
 	uint32_t height,
 	vk::Format format,
 	vk::ImageTiling tiling,
 	vk::ImageUsageFlags usage,
-	vk::MemoryPropertyFlags properties
+	vk::MemoryPropertyFlags properties,
+	uint32_t mipLevels
 )
 {
-	vk::raii::Image        image       = nullptr;
-	vk::raii::DeviceMemory imageMemory = nullptr;
-
 	vk::ImageCreateInfo imageInfo(
 		{},
 		vk::ImageType::e2D,
 		format,
 		{width, height, 1},
-		1,
+		mipLevels,
 		1,
 		vk::SampleCountFlagBits::e1,
 		tiling,
@@ -625,104 +1093,10 @@ std::pair<vk::raii::Image, vk::raii::DeviceMemory> Renderer::createImage(
 		vk::ImageLayout::eUndefined
 	);
 
-	image = device.createImage(imageInfo);
-
-	vk::MemoryRequirements memRequirements = image.getMemoryRequirements();
-
-	vk::MemoryAllocateInfo allocInfo(
-		memRequirements.size,
-		allocator.findMemoryType(memRequirements.memoryTypeBits, properties)
-	);
-
-	imageMemory = device.allocateMemory(allocInfo);
-
-	image.bindMemory(*imageMemory, 0);
-
-	return {std::move(image), std::move(imageMemory)};
-}
-
-void Renderer::transitionImageLayout(vk::Image image,
-	vk::Format,
-	vk::ImageLayout oldLayout,
-	vk::ImageLayout newLayout
-)
-{
-	auto singleCommand = makeSingleCommand();
-
-	vk::ImageMemoryBarrier barrier(
-		{}, // TODO
-		{}, // TODO
-		oldLayout,
-		newLayout,
-		VK_QUEUE_FAMILY_IGNORED,
-		VK_QUEUE_FAMILY_IGNORED,
-		image,
-		vk::ImageSubresourceRange(
-			vk::ImageAspectFlagBits::eColor,
-			0,
-			1,
-			0,
-			1
-		)
-	);
-
-	vk::PipelineStageFlags sourceStage;
-	vk::PipelineStageFlags destinationStage;
-
-	if(oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eTransferDstOptimal)
-	{
-		barrier.srcAccessMask = vk::AccessFlagBits::eNone;
-		barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
-
-		sourceStage      = vk::PipelineStageFlagBits::eTopOfPipe;
-		destinationStage = vk::PipelineStageFlagBits::eTransfer;
-	}
-	else if(oldLayout == vk::ImageLayout::eUndefined && newLayout == vk::ImageLayout::eDepthStencilAttachmentOptimal)
-	{
-		barrier.srcAccessMask = vk::AccessFlagBits::eNone;
-		barrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-
-		sourceStage      = vk::PipelineStageFlagBits::eTopOfPipe;
-		destinationStage = vk::PipelineStageFlagBits::eEarlyFragmentTests;
-	}
-	else if(oldLayout == vk::ImageLayout::eTransferDstOptimal && newLayout == vk::ImageLayout::eShaderReadOnlyOptimal)
-	{
-		barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
-		barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-
-		sourceStage      = vk::PipelineStageFlagBits::eTransfer;
-		destinationStage = vk::PipelineStageFlagBits::eFragmentShader;
-	}
-	else
-	{
-		throw std::invalid_argument("unsupported layout transition!");
-	}
-
-	singleCommand.getBuffer().pipelineBarrier(sourceStage, destinationStage, {}, {}, {}, barrier);
-}
-
-void Renderer::copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height)
-{
-	auto singleCommand = makeSingleCommand();
-
-	vk::BufferImageCopy region(
-		0,
-		0,
-		0,
-		vk::ImageSubresourceLayers(
-			vk::ImageAspectFlagBits::eColor,
-			0,
-			0,
-			1
-		),
-		{0, 0, 0},
-		{width, height, 1}
-	);
-
-	singleCommand.getBuffer().copyBufferToImage(buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+	return allocator.createImage(imageInfo, properties);
 }
 
-vk::raii::ImageView Renderer::createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags)
+vk::raii::ImageView Renderer::createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags, uint32_t mipLevels)
 {
 	vk::ImageViewCreateInfo viewInfo(
 		{},
@@ -730,7 +1104,7 @@ vk::raii::ImageView Renderer::createImageView(vk::Image image, vk::Format format
 		vk::ImageViewType::e2D,
 		format,
 		{},
-		vk::ImageSubresourceRange(aspectFlags, 0, 1, 0, 1)
+		vk::ImageSubresourceRange(aspectFlags, 0, mipLevels, 0, 1)
 	);
 
 	return device.createImageView(viewInfo);
@@ -738,7 +1112,7 @@ vk::raii::ImageView Renderer::createImageView(vk::Image image, vk::Format format
 
 void Renderer::createTextureImageView()
 {
-	textureImageView = createImageView(*textureImage, vk::Format::eR8G8B8A8Srgb);
+	textureImageView = createImageView(textureImage.image, vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor, textureMipLevels);
 }
 
 void Renderer::createTextureSampler()
@@ -757,7 +1131,7 @@ void Renderer::createTextureSampler()
 		false,
 		vk::CompareOp::eAlways,
 		0,
-		0,
+		textureMipLevels,
 		vk::BorderColor::eIntOpaqueBlack,
 		false
 	);
@@ -772,8 +1146,7 @@ SingleCommand Renderer::makeSingleCommand()
 
 vk::Extent2D Renderer::getWindowSize() const
 {
-	int width, height;
-	glfwGetWindowSize(engine.getWindow(), &width, &height);
+	glm::ivec2 size = engine.getWindowSize();
 
-	return vk::Extent2D(width, height);
+	return vk::Extent2D(size.x, size.y);
 }
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <span>
 #include <string_view>
@@ -26,12 +27,18 @@
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_raii.hpp>
 
+#include "../math/batch.hpp"
 #include "../scene.hpp"
 #include "allocator.hpp"
+#include "drawList.hpp"
 #include "pipeline.hpp"
+#include "pipelineCache.hpp"
 #include "queueFamilyIndices.hpp"
+#include "shaderStorageBufferObject.hpp"
 #include "singleCommand.hpp"
+#include "uploadManager.hpp"
 #include "frameData.hpp"
+#include "geometryBuffer.hpp"
 
 class Engine;
 
@@ -52,10 +59,6 @@ public:
 private:
 	static const int MAX_FRAMES_IN_FLIGHT = FrameData::MAX_FRAMES_IN_FLIGHT;
 
-	const std::vector<const char*> deviceExtensions = {
-		VK_KHR_SWAPCHAIN_EXTENSION_NAME
-	};
-
 #ifdef VK_DEBUG
 	const bool enableValidationLayers = true;
 	VkDebugUtilsMessengerEXT debugMessenger;
@@ -94,17 +97,22 @@ private:
 	vk::raii::Device         device         = nullptr;
 	vk::raii::Queue          graphicsQueue  = nullptr;
 	vk::raii::Queue          presentQueue   = nullptr;
+	vk::raii::Queue          transferQueue  = nullptr;
 	vk::raii::SurfaceKHR     surface        = nullptr;
 
-	Allocator allocator;
+	Allocator      allocator;
+	UploadManager  uploads;
+	UploadToken    sceneUploaded = 0;
+	GeometryBuffer geometry;
+	PipelineCache  pipelineCache;
 
 	vk::raii::CommandPool commandPool = nullptr;
 
 	vk::raii::ImageView textureImageView = nullptr;
 	vk::raii::Sampler   textureSampler   = nullptr;
 
-	vk::raii::Image        textureImage       = nullptr;
-	vk::raii::DeviceMemory textureImageMemory = nullptr;
+	Image    textureImage;
+	uint32_t textureMipLevels = 1;
 
 	vk::raii::DescriptorSetLayout descriptorSetLayout = nullptr;
 
@@ -113,14 +121,71 @@ private:
 
 	bool framebufferResized = false;
 
+	// The whole scene is drawn with a few drawIndexedIndirect.
+	bool     multiDrawIndirect    = false;
+	uint32_t maxDrawIndirectCount = 1;
+
+	// A compute pass keeps the visible instances of each indirect batch,
+	// in the order of the sorted draw list.
+	bool     gpuCulling        = false;
+	uint32_t maxCullWorkGroups = 1;
+
+	// VMA keeps allocations within the heap budgets reported by the driver.
+	bool memoryBudget = false;
+
 	// Non owning reference to the current scene.
-	Scene*                  activeScene = nullptr;
-	Engine&                 engine;
-	std::vector<Renderable> renderables;
+	Scene*                      activeScene = nullptr;
+	Engine&                     engine;
+	std::span<const Renderable> renderables;
+
+	// Scratch space of updateStorageBuffer().
+	std::vector<uint32_t>                  uploadObjects;
+	std::vector<glm::mat4>                 uploadModels;
+	std::vector<glm::mat4>                 uploadNormals;
+	std::vector<ShaderStorageBufferObject> uploadData;
+
+	// From the object staging buffer, recorded by recordObjectCopies().
+	std::vector<vk::BufferCopy> objectCopies;
+
+	// CPU culling, used when the GPU doesn't cull.
+	static const uint32_t CULL_CHUNK_SIZE = 4096;
+
+	// Instances of a batch culled by the GPU, a workgroup loops over them.
+	static const uint32_t GPU_CULL_BATCH_SIZE = 1024;
+
+	std::array<glm::vec4, 6> frustum;
+	math::Aabbs              bounds;
+
+	// Each chunk writes its visible objects at its own offset, they are
+	// compacted into visible.
+	std::vector<uint32_t>     visibleObjects;
+	std::vector<uint32_t>     visibleCounts;
+	std::span<const uint32_t> visible;
+
+	// Visible objects, or all of them when the GPU culls, sorted by state
+	// and front to back.
+	DrawList drawList;
+
+	// One instanced draw per run of equal state, its instances are
+	// consecutive in the instance buffer starting at firstInstance.
+	std::vector<vk::DrawIndexedIndirectCommand> batches;
+	std::vector<uint64_t>                       batchKeys;
+
+	// False when beginFrame() had to recreate the swap chain.
+	bool     frameReady = false;
+	uint32_t imageIndex = 0;
+
+	// Direct draws are split in secondary command buffers recorded in
+	// parallel when there are enough of them.
+	static const uint32_t PARALLEL_RECORDING_THRESHOLD = 2048;
+
+	bool parallelRecording = false;
 
 	void initVulkan();
 	void cleanup();
 
+	bool isHeadless() const;
+
 	void createInstance();
 	std::vector<const char*> getRequiredExtensions();
 
@@ -128,6 +193,7 @@ private:
 	bool isDeviceSuitable(vk::PhysicalDevice device);
 	QueueFamilyIndices findQueueFamilies(vk::PhysicalDevice device);
 
+	std::vector<const char*> getRequiredDeviceExtensions() const;
 	void createLogicalDevice();
 
 	void createSurface();
@@ -136,37 +202,59 @@ private:
 	bool checkDeviceExtensionSupport(vk::PhysicalDevice device);
 	SwapChainSupportDetails querySwapChainSupport(vk::PhysicalDevice device);
 
-	vk::raii::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags = vk::ImageAspectFlagBits::eColor);
+	vk::raii::ImageView createImageView(vk::Image image, vk::Format format, vk::ImageAspectFlags aspectFlags = vk::ImageAspectFlagBits::eColor, uint32_t mipLevels = 1);
+
+	/// Waits for the frame in flight and acquires its image.
+	bool beginFrame();
+
+	/// Uploads what changed and chooses how to record.
+	void prepareFrame();
+
+	/// Records a share of the batches into a secondary command buffer.
+	void recordSecondary(size_t chunk);
 
-	void drawFrame();
-	void copyBuffer(vk::Buffer srcBuffer, vk::Buffer dstBuffer, vk::DeviceSize size);
+	/// Records, submits and presents.
+	void submitFrame();
 
 	void createDescriptorSetLayout();
 	void updateUniformBuffer();
 	void updateStorageBuffer();
+	void recordObjectCopies(vk::CommandBuffer commandBuffer);
+
+	vk::DrawIndexedIndirectCommand getDrawCommand(uint32_t object) const;
+
+	/// World space boxes of the objects that changed.
+	void updateBounds(std::span<const uint32_t> objects);
+	void compactVisibleObjects();
+
+	/// Every object that isn't a free slot, the GPU culls them.
+	void listObjects();
+
+	/// Sorts the visible objects into the instance buffer, grouped by state.
+	void buildBatches();
+	void updateIndirectBuffer();
 
 	void createTextureImage();
-	std::pair<vk::raii::Image, vk::raii::DeviceMemory> createImage(uint32_t width,
+	Image createImage(uint32_t width,
 		uint32_t height,
 		vk::Format format,
 		vk::ImageTiling tiling,
 		vk::ImageUsageFlags usage,
-		vk::MemoryPropertyFlags properties
-	);
-	void transitionImageLayout(vk::Image image,
-		vk::Format format,
-		vk::ImageLayout oldLayout,
-		vk::ImageLayout newLayout
+		vk::MemoryPropertyFlags properties,
+		uint32_t mipLevels = 1
 	);
-	void copyBufferToImage(vk::Buffer buffer, vk::Image image, uint32_t width, uint32_t height);
 	void createTextureImageView();
 	void createTextureSampler();
 
 	friend class Allocator;
 	friend class Depth;
 	friend class FrameData;
+	friend class GeometryBuffer;
 	friend struct Mesh;
 	friend struct Pipeline;
+	friend struct Scene;
+	friend class PipelineCache;
+	friend class UploadManager;
 
 protected:
 	SingleCommand makeSingleCommand();
@@ -22,4 +22,11 @@ struct ShaderStorageBufferObject
 {
 	alignas(16) glm::mat4 model;
 	alignas(16) glm::mat4 normalMatrix;
+
+	// Mesh bounds in model space.
+	alignas(16) glm::vec4 aabbMin;
+	alignas(16) glm::vec4 aabbMax;
+
+	// indexCount, firstIndex and vertexOffset, indexCount is 0 in free slots.
+	alignas(16) glm::uvec4 draw;
 };
@@ -23,4 +23,7 @@ struct UniformBufferObject
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
 	alignas(16) glm::mat4 projView;
+
+	// World space planes, see math::frustumPlanes().
+	alignas(16) glm::vec4 frustum[6];
 };
@@ -0,0 +1,379 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "renderer.hpp"
+#include "uploadManager.hpp"
+
+UploadManager::UploadManager(Renderer& root):
+	root(root)
+{}
+
+void UploadManager::create()
+{
+	staging = root.allocator.createBuffer(
+		STAGING_SIZE,
+		vk::BufferUsageFlagBits::eTransferSrc,
+		MemoryUsage::Upload
+	);
+
+	QueueFamilyIndices indices = root.findQueueFamilies(*root.physicalDevice);
+
+	graphicsFamily = indices.graphicsFamily.value();
+	queueFamily    = indices.transferFamily.value_or(graphicsFamily);
+	queueFamilies  = {graphicsFamily, queueFamily};
+	queue          = &root.transferQueue;
+
+	vk::CommandPoolCreateInfo poolInfo(
+		vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+		queueFamily
+	);
+
+	commandPool = root.device.createCommandPool(poolInfo);
+
+	vk::SemaphoreTypeCreateInfo timelineInfo(vk::SemaphoreType::eTimeline, 0);
+	vk::SemaphoreCreateInfo     semaphoreInfo({}, &timelineInfo);
+
+	semaphore = root.device.createSemaphore(semaphoreInfo);
+}
+
+bool UploadManager::needsOwnershipTransfer() const
+{
+	return queueFamily != graphicsFamily;
+}
+
+vk::DeviceSize UploadManager::allocate(vk::DeviceSize size, vk::DeviceSize alignment)
+{
+	if(size > STAGING_SIZE)
+		throw std::runtime_error("upload is bigger than the staging buffer!");
+
+	vk::DeviceSize offset;
+	vk::DeviceSize needed;
+
+	for(;;)
+	{
+		// An empty ring starts over, so anything up to STAGING_SIZE fits.
+		if(used == 0)
+			head = 0;
+
+		offset = (head + alignment - 1) / alignment * alignment;
+
+		// It doesn't fit before the end, the rest is skipped.
+		if(offset + size > STAGING_SIZE)
+			offset = 0;
+
+		needed = (offset >= head ? offset - head : STAGING_SIZE - head) + size;
+
+		if(used + needed <= STAGING_SIZE)
+			break;
+
+		// The ring is full of copies that haven't been submitted.
+		if(submissions.empty())
+			submit();
+
+		wait(submissions.front().token);
+		reclaim();
+	}
+
+	head          = offset + size;
+	used         += needed;
+	recordedSize += needed;
+
+	return offset;
+}
+
+void UploadManager::reclaim()
+{
+	UploadToken completed = semaphore.getCounterValue();
+
+	while(!submissions.empty() && submissions.front().token <= completed)
+	{
+		Submission& submission = submissions.front();
+
+		used -= submission.size;
+
+		submission.commandBuffer.reset();
+		freeCommandBuffers.emplace_back(std::move(submission.commandBuffer));
+
+		submissions.pop_front();
+	}
+}
+
+vk::CommandBuffer UploadManager::getCommandBuffer()
+{
+	if(*recording)
+		return *recording;
+
+	reclaim();
+
+	if(!freeCommandBuffers.empty())
+	{
+		recording = std::move(freeCommandBuffers.back());
+		freeCommandBuffers.pop_back();
+	}
+	else
+	{
+		vk::CommandBufferAllocateInfo allocInfo(*commandPool, vk::CommandBufferLevel::ePrimary, 1);
+
+		recording = std::move(root.device.allocateCommandBuffers(allocInfo).front());
+	}
+
+	recording.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+	return *recording;
+}
+
+UploadToken UploadManager::upload(vk::Buffer dst, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size)
+{
+	// Big uploads are split, so they never need the whole ring.
+	const vk::DeviceSize chunkSize = STAGING_SIZE / 4;
+
+	for(vk::DeviceSize done = 0; done < size; done += chunkSize)
+	{
+		vk::DeviceSize chunk  = std::min(chunkSize, size - done);
+		vk::DeviceSize offset = allocate(chunk, 16);
+
+		memcpy((char*)staging.allocationInfo.pMappedData + offset, (const char*)data + done, chunk);
+		staging.flush(offset, chunk);
+
+		vk::BufferCopy copyRegion(offset, dstOffset + done, chunk);
+
+		getCommandBuffer().copyBuffer(staging.buffer, dst, copyRegion);
+	}
+
+	// dst is concurrent, the semaphore wait of the frames makes the copies
+	// visible.
+	return getPendingToken();
+}
+
+UploadToken UploadManager::uploadImage(vk::Image image, vk::Extent3D extent, const void* data, vk::DeviceSize size, uint32_t mipLevels)
+{
+	using enum vk::AccessFlagBits;
+	using enum vk::PipelineStageFlagBits;
+
+	vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, mipLevels, 0, 1);
+
+	vk::ImageMemoryBarrier toTransfer(
+		{},
+		eTransferWrite,
+		vk::ImageLayout::eUndefined,
+		vk::ImageLayout::eTransferDstOptimal,
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		image,
+		range
+	);
+
+	getCommandBuffer().pipelineBarrier(eTopOfPipe, eTransfer, {}, {}, {}, toTransfer);
+
+	// Big images are copied in row ranges, so they never need the whole
+	// ring. Rows are tightly packed and images are 2D.
+	const vk::DeviceSize chunkSize = STAGING_SIZE / 4;
+	const vk::DeviceSize rowSize   = size / extent.height;
+	const uint32_t       chunkRows = std::max<vk::DeviceSize>(1, chunkSize / rowSize);
+
+	for(uint32_t row = 0; row < extent.height; row += chunkRows)
+	{
+		uint32_t       rows   = std::min(chunkRows, extent.height - row);
+		vk::DeviceSize chunk  = rows * rowSize;
+		vk::DeviceSize offset = allocate(chunk, 16);
+
+		memcpy((char*)staging.allocationInfo.pMappedData + offset, (const char*)data + row * rowSize, chunk);
+		staging.flush(offset, chunk);
+
+		vk::BufferImageCopy region(
+			offset,
+			0,
+			0,
+			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1),
+			{0, (int32_t)row, 0},
+			{extent.width, rows, 1}
+		);
+
+		getCommandBuffer().copyBufferToImage(staging.buffer, image, vk::ImageLayout::eTransferDstOptimal, region);
+	}
+
+	Mipmaps imageMipmaps{image, extent, mipLevels};
+
+	if(needsOwnershipTransfer())
+	{
+		// Transfer queues can't blit or reach the fragment stage, the
+		// graphics queue does the rest.
+		vk::ImageMemoryBarrier release(
+			eTransferWrite,
+			{},
+			vk::ImageLayout::eTransferDstOptimal,
+			vk::ImageLayout::eTransferDstOptimal,
+			queueFamily,
+			graphicsFamily,
+			image,
+			range
+		);
+
+		getCommandBuffer().pipelineBarrier(eTransfer, eBottomOfPipe, {}, {}, {}, release);
+
+		vk::ImageMemoryBarrier acquire = release;
+		acquire.srcAccessMask = {};
+		acquire.dstAccessMask = eTransferRead | eTransferWrite;
+
+		recordedImageAcquires.push_back(acquire);
+		recordedMipmaps.push_back(imageMipmaps);
+	}
+	else
+		recordMipmaps(getCommandBuffer(), imageMipmaps);
+
+	return getPendingToken();
+}
+
+void UploadManager::recordMipmaps(vk::CommandBuffer commandBuffer, const Mipmaps& mipmaps)
+{
+	using enum vk::AccessFlagBits;
+	using enum vk::ImageLayout;
+	using enum vk::PipelineStageFlagBits;
+
+	vk::ImageMemoryBarrier barrier(
+		{},
+		{},
+		{},
+		{},
+		VK_QUEUE_FAMILY_IGNORED,
+		VK_QUEUE_FAMILY_IGNORED,
+		mipmaps.image,
+		vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)
+	);
+
+	int32_t width  = mipmaps.extent.width;
+	int32_t height = mipmaps.extent.height;
+
+	// Each level is blitted from the previous one, which is then done.
+	for(uint32_t level = 1; level < mipmaps.mipLevels; level++)
+	{
+		barrier.subresourceRange.baseMipLevel = level - 1;
+		barrier.oldLayout     = eTransferDstOptimal;
+		barrier.newLayout     = eTransferSrcOptimal;
+		barrier.srcAccessMask = eTransferWrite;
+		barrier.dstAccessMask = eTransferRead;
+
+		commandBuffer.pipelineBarrier(eTransfer, eTransfer, {}, {}, {}, barrier);
+
+		int32_t mipWidth  = std::max(width / 2, 1);
+		int32_t mipHeight = std::max(height / 2, 1);
+
+		vk::ImageBlit blit(
+			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level - 1, 0, 1),
+			{vk::Offset3D(0, 0, 0), vk::Offset3D(width, height, 1)},
+			vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, level, 0, 1),
+			{vk::Offset3D(0, 0, 0), vk::Offset3D(mipWidth, mipHeight, 1)}
+		);
+
+		commandBuffer.blitImage(mipmaps.image, eTransferSrcOptimal, mipmaps.image, eTransferDstOptimal, blit, vk::Filter::eLinear);
+
+		barrier.oldLayout     = eTransferSrcOptimal;
+		barrier.newLayout     = eShaderReadOnlyOptimal;
+		barrier.srcAccessMask = eTransferRead;
+		barrier.dstAccessMask = eShaderRead;
+
+		commandBuffer.pipelineBarrier(eTransfer, eFragmentShader, {}, {}, {}, barrier);
+
+		width  = mipWidth;
+		height = mipHeight;
+	}
+
+	// The last level is never blitted from.
+	barrier.subresourceRange.baseMipLevel = mipmaps.mipLevels - 1;
+	barrier.oldLayout     = eTransferDstOptimal;
+	barrier.newLayout     = eShaderReadOnlyOptimal;
+	barrier.srcAccessMask = eTransferWrite;
+	barrier.dstAccessMask = eShaderRead;
+
+	commandBuffer.pipelineBarrier(eTransfer, eFragmentShader, {}, {}, {}, barrier);
+}
+
+UploadToken UploadManager::submit()
+{
+	if(!*recording)
+		return lastSubmitted;
+
+	recording.end();
+
+	UploadToken token = getPendingToken();
+
+	vk::TimelineSemaphoreSubmitInfo timelineInfo({}, token);
+
+	vk::SubmitInfo submitInfo({}, {}, *recording, *semaphore, &timelineInfo);
+
+	queue->submit(submitInfo);
+
+	submissions.emplace_back(token, std::move(recording), recordedSize);
+
+	imageAcquires.insert(imageAcquires.end(), recordedImageAcquires.begin(), recordedImageAcquires.end());
+
+	submittedMipmaps.insert(submittedMipmaps.end(), recordedMipmaps.begin(), recordedMipmaps.end());
+
+	recordedImageAcquires.clear();
+	recordedMipmaps.clear();
+
+	recording     = nullptr;
+	recordedSize  = 0;
+	lastSubmitted = token;
+
+	return token;
+}
+
+void UploadManager::recordAcquires(vk::CommandBuffer commandBuffer)
+{
+	if(imageAcquires.empty())
+		return;
+
+	// The semaphore wait at WAIT_STAGES comes first.
+	commandBuffer.pipelineBarrier(WAIT_STAGES, WAIT_STAGES, {}, {}, {}, imageAcquires);
+
+	for(const auto& imageMipmaps: submittedMipmaps)
+		recordMipmaps(commandBuffer, imageMipmaps);
+
+	imageAcquires.clear();
+	submittedMipmaps.clear();
+}
+
+UploadToken UploadManager::getPendingToken() const
+{
+	return lastSubmitted + 1;
+}
+
+void UploadManager::wait(UploadToken token)
+{
+	if(token > lastSubmitted)
+		submit();
+
+	vk::Result result = root.device.waitSemaphores(vk::SemaphoreWaitInfo({}, *semaphore, token), std::numeric_limits<uint64_t>::max());
+
+	if(result != vk::Result::eSuccess)
+		throw std::runtime_error("failed to wait for the uploads!");
+}
+
+vk::Semaphore UploadManager::getSemaphore() const
+{
+	return *semaphore;
+}
+
+std::span<const uint32_t> UploadManager::getQueueFamilies() const
+{
+	return std::span(queueFamilies).first(needsOwnershipTransfer() ? 2 : 1);
+}
@@ -0,0 +1,154 @@
+// Vulkan
+// Copyright © 2020 otreblan
+//
+// vulkan-hello is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// vulkan-hello is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with vulkan-hello.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <vector>
+
+#include <vulkan/vulkan_raii.hpp>
+
+#include "allocator.hpp"
+
+class Renderer;
+
+/// Timeline value signaled when an upload is done.
+using UploadToken = uint64_t;
+
+/// Batches copies to device local memory through a persistent staging ring.
+///
+/// Copies are recorded into one command buffer until submit(), which
+/// signals a timeline semaphore with the token of the batch. Nothing blocks
+/// unless the ring is full.
+///
+/// They run on a transfer only queue when there is one. Buffers are shared
+/// with the graphics queue and images are acquired by it with
+/// recordAcquires().
+class UploadManager
+{
+public:
+	/// Where frames wait for the uploads.
+	static constexpr vk::PipelineStageFlags WAIT_STAGES =
+		vk::PipelineStageFlagBits::eTransfer |
+		vk::PipelineStageFlagBits::eVertexInput |
+		vk::PipelineStageFlagBits::eFragmentShader;
+
+private:
+	static const vk::DeviceSize STAGING_SIZE = 64 << 20;
+
+	/// An image whose first level was uploaded and whose other levels are
+	/// blitted from it.
+	struct Mipmaps
+	{
+		vk::Image    image;
+		vk::Extent3D extent;
+		uint32_t     mipLevels;
+	};
+
+	struct Submission
+	{
+		UploadToken             token;
+		vk::raii::CommandBuffer commandBuffer;
+
+		// Ring bytes released when it completes.
+		vk::DeviceSize size;
+	};
+
+	Renderer& root;
+
+	Buffer staging;
+
+	// Next free byte and bytes in use, including the ones skipped when
+	// wrapping around.
+	vk::DeviceSize head = 0;
+	vk::DeviceSize used = 0;
+
+	uint32_t queueFamily    = 0;
+	uint32_t graphicsFamily = 0;
+
+	std::array<uint32_t, 2> queueFamilies = {};
+
+	vk::raii::Queue*      queue       = nullptr;
+	vk::raii::CommandPool commandPool = nullptr;
+	vk::raii::Semaphore   semaphore   = nullptr;
+
+	// The batch being recorded.
+	vk::raii::CommandBuffer recording    = nullptr;
+	vk::DeviceSize          recordedSize = 0;
+
+	std::deque<Submission>               submissions;
+	std::vector<vk::raii::CommandBuffer> freeCommandBuffers;
+
+	UploadToken lastSubmitted = 0;
+
+	// Image ownership transfers to the graphics family, released by the
+	// batch being recorded and by submitted batches.
+	std::vector<vk::ImageMemoryBarrier> recordedImageAcquires;
+	std::vector<vk::ImageMemoryBarrier> imageAcquires;
+
+	// Blits need a graphics queue, they follow the acquires.
+	std::vector<Mipmaps> recordedMipmaps;
+	std::vector<Mipmaps> submittedMipmaps;
+
+	bool needsOwnershipTransfer() const;
+
+	/// Returns the offset in the ring, it waits for old batches if it's full.
+	vk::DeviceSize allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+
+	/// Frees the ring space and command buffers of completed batches.
+	void reclaim();
+
+	vk::CommandBuffer getCommandBuffer();
+
+	/// Every level goes from eTransferDstOptimal to eShaderReadOnlyOptimal.
+	static void recordMipmaps(vk::CommandBuffer commandBuffer, const Mipmaps& mipmaps);
+
+public:
+	UploadManager(Renderer& root);
+
+	void create();
+
+	/// Copies data to dst at dstOffset, done when the returned token is.
+	/// dst must be created with getQueueFamilies().
+	UploadToken upload(vk::Buffer dst, vk::DeviceSize dstOffset, const void* data, vk::DeviceSize size);
+
+	/// Copies tightly packed texels to the first mip level of image and
+	/// blits the rest, every level ends in eShaderReadOnlyOptimal.
+	UploadToken uploadImage(vk::Image image, vk::Extent3D extent, const void* data, vk::DeviceSize size, uint32_t mipLevels = 1);
+
+	/// Submits the recorded copies, it returns their token.
+	UploadToken submit();
+
+	/// Acquires what the submitted copies wrote and blits their mip levels,
+	/// in a graphics command buffer that waits for the token of the last
+	/// submit() at WAIT_STAGES.
+	void recordAcquires(vk::CommandBuffer commandBuffer);
+
+	/// Token of the copies that are being recorded.
+	UploadToken getPendingToken() const;
+
+	/// Blocks until the token is done, submitting it if needed.
+	void wait(UploadToken token);
+
+	vk::Semaphore getSemaphore() const;
+
+	/// Graphics and upload families when they differ, for buffers that
+	/// uploads write and frames read.
+	std::span<const uint32_t> getQueueFamilies() const;
+};
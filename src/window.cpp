@@ -21,6 +21,10 @@ Window::Window(Engine& engine):
 	window(nullptr, nullptr),
 	engine(engine)
 {
+	// There may not be a display to connect to.
+	if(engine.getOptions().headless)
+		return;
+
 	if(!glfwInit())
 		throw;
 
@@ -43,3 +47,13 @@ GLFWwindow* Window::getWindow()
 {
 	return window.get();
 }
+
+glm::ivec2 Window::getSize() const
+{
+	glm::ivec2 size(width, height);
+
+	if(window)
+		glfwGetWindowSize(window.get(), &size.x, &size.y);
+
+	return size;
+}
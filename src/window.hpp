@@ -17,6 +17,7 @@
 #pragma once
 
 #include <GLFW/glfw3.h>
+#include <glm/vec2.hpp>
 
 #include <memory>
 
@@ -37,5 +38,7 @@ public:
 	Window(Engine& engine);
 	~Window();
 
+	/// Returns nullptr in headless mode.
 	GLFWwindow* getWindow();
+	glm::ivec2  getSize() const;
 };